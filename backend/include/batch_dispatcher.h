@@ -0,0 +1,90 @@
+#ifndef BATCH_DISPATCHER_H
+#define BATCH_DISPATCHER_H
+
+#include "spatial_index.h"
+#include "graph.h"
+#include <vector>
+#include <utility>
+using namespace std;
+
+struct PickupRequest {
+    int riderId;
+    point pickup;
+    TaxiFilter filter;
+
+    PickupRequest(int riderId, const point& pickup, const TaxiFilter& filter = TaxiFilter::available())
+        : riderId(riderId), pickup(pickup), filter(filter) {}
+};
+
+struct Booking {
+    int riderId;
+    point pickup;
+    point taxi;
+    int distance;
+};
+
+struct DispatchConfig {
+    int candidatesPerRider;  // kNN fan-out that forms each rider's edges
+    double budgetMs;         // wall-clock budget for one dispatch round
+    int workers;             // threads solving components; 0 = hardware
+    double maxExactWork;     // riders^2 * taxis above which a component goes greedy
+    int landmarks;           // ALT landmarks on the road graph; 0 = plain Dijkstra
+
+    DispatchConfig() : candidatesPerRider(8), budgetMs(20.0), workers(0), maxExactWork(5e7), landmarks(4) {}
+};
+
+struct DispatchResult {
+    vector<Booking> bookings;
+    vector<int> unassigned;
+    int components;
+    int greedyComponents;
+    long long totalDistance;
+    double elapsedMs;
+};
+
+// Assigns a window of pending pickups to taxis at once. Each rider is linked
+// to its candidatesPerRider nearest matching taxis, the resulting bipartite
+// graph is split into connected components, and every component is solved
+// as a min-cost assignment (Hungarian) on a worker pool. Components started
+// after the budget has run out, or too large to solve exactly, fall back to
+// greedy cheapest-edge matching on Manhattan distance.
+//
+// With a road graph, every pickup is first linked to its candidates the way
+// the single-rider route does and costs are shortest road distances;
+// without one, costs are Manhattan distances. Those links are Manhattan
+// paths, so a graph only changes the costs if it has streets shorter than
+// them; TaxiEngine, whose streets never are, passes none. Once the graph is
+// complete, landmarks are built on it so those searches run as A*. As with
+// a single booking, assigned taxis are moved to their pickups and marked
+// BOOKED in the index before dispatch returns.
+class BatchDispatcher {
+private:
+    struct Edge {
+        int rider;
+        int taxi;
+        long long cost;
+    };
+
+    struct Component {
+        vector<int> riders;
+        vector<int> taxis;
+        vector<Edge> edges;
+    };
+
+    SpatialIndex& index;
+    DispatchConfig config;
+    GridGraph* roads;
+
+    static int manhattan(const point& a, const point& b);
+    static int findRoot(vector<int>& parent, int v);
+    static void solveHungarian(const Component& component, vector<Edge>& matches);
+    static void solveGreedy(const Component& component, vector<Edge>& matches);
+
+public:
+    BatchDispatcher(SpatialIndex& index, const DispatchConfig& config = DispatchConfig(),
+                    GridGraph* roads = nullptr);
+
+    DispatchResult dispatch(const vector<PickupRequest>& window);
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef COMPACT_KD_TREE_H
+#define COMPACT_KD_TREE_H
+
+#include "spatial_index.h"
+#include <cstdint>
+#include <memory>
+#include <queue>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// KD-tree whose nodes live in one contiguous array and link through 32-bit
+// indices. Coordinates and bounding boxes are stored as Coord (int16_t or
+// int32_t, see makeCompactKDTree), attributes as bytes, and height plus
+// flags share two bytes. Bulk builds lay nodes out in preorder so a left
+// child usually sits right after its parent.
+//
+// Deletes leave tombstones; the array is rebuilt once the dead share passes
+// the compaction threshold. Points that do not fit in Coord are ignored and
+// capacities above 255 are stored as 255.
+template <typename Coord>
+class CompactKDTree : public SpatialIndex {
+private:
+    static const uint32_t NIL = 0xffffffffu;
+
+    enum : uint8_t { DELETED = 1, SUBTREE_AVAILABLE = 2 };
+
+    struct Node {
+        Coord x, y;
+        Coord minX, minY, maxX, maxY;
+        uint32_t left, right;
+        uint32_t classMask;
+        uint8_t status, vehicleClass, capacity, maxCapacity;
+        uint8_t height, flags;
+    };
+
+    struct KnnSearch {
+        double scale;  // (1 + epsilon)^2
+        int budget;    // node visits allowed, 0 for no limit
+        int visited;
+        bool approximate;
+    };
+
+    vector<Node> nodes;
+    uint32_t root;
+    int live;
+    int dead;
+    double compactionThreshold;
+
+    static bool fits(const point& p);
+    static point pointOf(const Node& n);
+    static TaxiAttributes attrOf(const Node& n);
+    static void setAttr(Node& n, const TaxiAttributes& attr);
+    uint32_t newNode(const point& p, const TaxiAttributes& attr);
+    int heightOf(uint32_t i) const;
+    void updateNode(uint32_t i);
+    bool isBalanced(uint32_t i) const;
+    bool compare(const point& a, const point& b, int depth) const;
+    uint32_t find(const point& p) const;
+    void collect(uint32_t i, vector<uint32_t>& out) const;
+    uint32_t relink(vector<uint32_t>& idx, int depth, int start, int end);
+    uint32_t buildRange(vector<pair<point, TaxiAttributes>>& items, int depth, int start, int end);
+    void rebuildAll(vector<pair<point, TaxiAttributes>>& items);
+    void compact();
+    uint32_t insertRecursive(uint32_t i, const point& p, const TaxiAttributes& attr, bool replaceAttr, int depth);
+    bool markDeleted(uint32_t i, const point& p, int depth);
+    bool setAttributesRecursive(uint32_t i, const point& p, const TaxiAttributes& attr, int depth);
+    bool mayMatch(const Node& n, const TaxiFilter& filter) const;
+    double boxDistanceSquared(const Node& n, const point& query) const;
+    void knnHelper(uint32_t i, const point& query, priority_queue<pair<double, uint32_t>>& pq,
+                   int k, const TaxiFilter& filter, KnnSearch& search) const;
+    void rangeHelper(uint32_t i, const point& low, const point& high, vector<point>& result) const;
+    void appendPoints(uint32_t i, vector<point>& points) const;
+    void collectLive(uint32_t i, vector<pair<point, TaxiAttributes>>& taxis) const;
+
+public:
+    CompactKDTree(double compactionThreshold = 0.25);
+
+    void buildFromVector(const vector<point>& points) override;
+    void buildFromVector(const vector<point>& points, const vector<TaxiAttributes>& attrs) override;
+    void insert(const point& p) override;
+    void insert(const point& p, const TaxiAttributes& attr) override;
+    bool deletePoint(const point& p) override;
+    bool search(const point& p) override;
+    vector<point> kNearestNeighbors(const point& query, int k) override;
+    vector<point> kNearestNeighbors(const point& query, int k, const TaxiFilter& filter) override;
+    KnnResult kNearestNeighbors(const point& query, int k, const TaxiFilter& filter,
+                                const KnnOptions& options) override;
+    bool setAttributes(const point& p, const TaxiAttributes& attr) override;
+    bool getAttributes(const point& p, TaxiAttributes& attr) override;
+    vector<point> rangeSearch(const point& low, const point& high) override;
+    int getHeight() override;
+    int size() override;
+    void getAllPoints(vector<point>& points) override;
+    void getAllTaxis(vector<pair<point, TaxiAttributes>>& taxis) override;
+    string name() const override;
+
+    int tombstoneCount() const;
+    size_t memoryBytes() const;
+    static size_t nodeBytes();
+};
+
+// Picks 16-bit coordinates when [minCoord, maxCoord] fits, 32-bit otherwise.
+unique_ptr<SpatialIndex> makeCompactKDTree(int minCoord, int maxCoord);
+
+#endif
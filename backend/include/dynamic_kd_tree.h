@@ -2,6 +2,7 @@
 #define DYNAMIC_KD_TREE_H
 
 #include "kdnode.h"
+#include "spatial_index.h"
 #include <iostream>
 #include <vector>
 #include <algorithm>
@@ -10,10 +11,63 @@
 #include <utility>
 using namespace std;
 
+// EAGER unlinks a deleted node right away. TOMBSTONE only marks it dead (a
+// dead leaf is unlinked at once) and compacts the highest subtree of at
+// least MIN_COMPACTION_SIZE nodes whose share of dead nodes passes the
+// threshold.
+enum class DeleteMode { EAGER, TOMBSTONE };
 
-class DynamicKDTree {
+// How much rebalancing work the tree has done since the last reset.
+struct RebuildStats {
+    size_t rebuilds;        // subtrees rebuilt because they went out of balance
+    size_t rebuiltNodes;    // nodes relinked by those rebuilds
+    size_t compactions;     // subtrees compacted to drop tombstones
+    size_t compactedNodes;  // nodes, live or dead, visited by those compactions
+};
+
+class DynamicKDTree;
+
+// Yields the taxis matching a filter in increasing distance from the query,
+// best-first over subtree boxes and points. Each call to next() resumes
+// from the frontier the previous one left, so pulling k taxis one at a time
+// costs the same as a single k-NN search. The tree must not change while an
+// iterator over it is in use.
+class NearestTaxiIterator {
+private:
+    struct Entry {
+        double dist;
+        KDNode* node;
+        bool isPoint;  // the node's own taxi, not its subtree
+
+        bool operator>(const Entry& other) const;
+    };
+
+    DynamicKDTree* tree;
+    point query;
+    TaxiFilter filter;
+    priority_queue<Entry, vector<Entry>, greater<Entry>> frontier;
+    int visited;
+
+    NearestTaxiIterator(DynamicKDTree* tree, const point& query, const TaxiFilter& filter);
+    void pushSubtree(KDNode* node);
+
+    friend class DynamicKDTree;
+
+public:
+    bool next(point& taxi);
+    bool next(point& taxi, double& distanceSquared);
+    int nodesVisited() const;
+};
+
+class DynamicKDTree : public SpatialIndex {
 private:
     KDNode* root;
+    DeleteMode mode;
+    double compactionThreshold;
+    RebuildStats stats;
+    int buildThreads;
+
+    static const int MIN_COMPACTION_SIZE = 64;
 
     struct NodeDist {
         KDNode* node;
@@ -22,8 +76,17 @@ private:
         bool operator<(const NodeDist& other) const;
     };
 
+    // Per-query state of a possibly approximate k-NN search.
+    struct KnnSearch {
+        double scale;  // (1 + epsilon)^2, applied to squared box distances
+        int budget;    // node visits allowed, 0 for no limit
+        int visited;
+        bool approximate;
+    };
+
     int getHeight(KDNode* node);
     void updateHeight(KDNode* node);
+    void updateNode(KDNode* node);
     int getBalanceFactor(KDNode* node);
     bool isBalanced(KDNode* node);
     bool compareXY(const point& a, const point& b);
@@ -31,19 +94,33 @@ private:
     bool compare(const point& a, const point& b, int depth);
     KDNode* search(KDNode* node, const point& p, int depth);
     KDNode* rebuild(KDNode* node, int depth);
-    void collectpoints(KDNode* node, vector<point>& points);
-    KDNode* buildBalanced(vector<point>& points, int depth, int start, int end);
+    void collectNodes(KDNode* node, vector<KDNode*>& nodes);
+    KDNode* buildBalanced(vector<KDNode*>& nodes, int depth, int start, int end);
     bool comp_xy_points(int a, int b, const vector<point>& data);
     bool comp_yx_points(int a, int b, const vector<point>& data);
-    KDNode* buildKDTreeFromVector(vector<int>& xy_superKey_temp, vector<int>& yx_superKey_temp,
-                                  bool div_x, const vector<point>& data);
-    KDNode* insertRecursive(KDNode* node, const point& p, int depth, bool& needRebalance);
+    KDNode* buildKDTreeFromVector(int* xy_superKey, int* yx_superKey, int* scratch, int len,
+                                  bool div_x, const vector<point>& data,
+                                  const vector<TaxiAttributes>& attrs, int spawnDepth);
+    int threadsForBuild() const;
+    KDNode* insertRecursive(KDNode* node, const point& p, const TaxiAttributes& attr,
+                            bool replaceAttr, int depth, bool& needRebalance);
     KDNode* findMin(KDNode* node, int dim, int depth);
     KDNode* findMax(KDNode* node, int dim, int depth);
     KDNode* deleteRecursive(KDNode* node, const point& p, int depth, bool& found);
+    KDNode* tombstoneRecursive(KDNode* node, const point& p, int depth, bool& found);
+    KDNode* compactPath(KDNode* node, const point& p, int depth);
+    KDNode* compact(KDNode* node, int depth);
+    KDNode* buildPresorted(const vector<point>& points, const vector<TaxiAttributes>& attrs, bool div_x);
     void deleteTree(KDNode* node);
-    void knnHelper(KDNode* node, const point& query, int depth,
-                   priority_queue<NodeDist>& pq, int k);
+    bool setAttributesRecursive(KDNode* node, const point& p, const TaxiAttributes& attr, int depth);
+    bool mayMatch(KDNode* node, const TaxiFilter& filter);
+    double boxDistanceSquared(KDNode* node, const point& query);
+    void knnHelper(KDNode* node, const point& query, priority_queue<NodeDist>& pq, int k,
+                   const TaxiFilter& filter, KnnSearch& search);
+    void rangeHelper(KDNode* node, const point& low, const point& high, vector<point>& result);
+    int liveCount(KDNode* node, bool availableOnly);
+    int rangeCountHelper(KDNode* node, const point& low, const point& high, bool availableOnly);
+    void zoneCountHelper(KDNode* node, const ZoneGrid& grid, bool availableOnly, vector<int>& counts);
     void nearestNeighbor(KDNode* node,
                          const point& query,
                          int depth,
@@ -56,18 +133,42 @@ public:
     DynamicKDTree(const vector<point>& initialPoints);
     ~DynamicKDTree();
 
-    void buildFromVector(const vector<point>& points);
-    void insert(const point& p);
-    bool deletePoint(const point& p);
-    bool search(const point& p);
-    vector<point> kNearestNeighbors(const point& query, int k);
-    int getHeight();
-    int size();
+    void buildFromVector(const vector<point>& points) override;
+    void buildFromVector(const vector<point>& points, const vector<TaxiAttributes>& attrs) override;
+    void insert(const point& p) override;
+    void insert(const point& p, const TaxiAttributes& attr) override;
+    bool deletePoint(const point& p) override;
+    bool search(const point& p) override;
+    vector<point> kNearestNeighbors(const point& query, int k) override;
+    vector<point> kNearestNeighbors(const point& query, int k, const TaxiFilter& filter) override;
+    KnnResult kNearestNeighbors(const point& query, int k, const TaxiFilter& filter,
+                                const KnnOptions& options) override;
+    bool setAttributes(const point& p, const TaxiAttributes& attr) override;
+    bool getAttributes(const point& p, TaxiAttributes& attr) override;
+    vector<point> rangeSearch(const point& low, const point& high) override;
+    int rangeCount(const point& low, const point& high, bool availableOnly = false) override;
+    vector<int> zoneCounts(const ZoneGrid& grid, bool availableOnly = false) override;
+    NearestTaxiIterator nearest(const point& query, const TaxiFilter& filter = TaxiFilter::any());
+    int getHeight() override;
+    int size() override;
     void countNodes(KDNode* node, int& count);
     void inorder();
     void inorderHelper(KDNode* node);
-    void getAllPoints(vector<point>& points);
+    void getAllPoints(vector<point>& points) override;
     void getAllPointsHelper(KDNode* node, vector<point>& points);
+    void getAllTaxis(vector<pair<point, TaxiAttributes>>& taxis) override;
+    void getAllTaxisHelper(KDNode* node, vector<pair<point, TaxiAttributes>>& taxis);
+    int availableCount();
+    void setDeleteMode(DeleteMode mode, double compactionThreshold = 0.25);
+    DeleteMode deleteMode() const;
+    int tombstoneCount();
+    size_t compactionCount() const;
+    RebuildStats rebuildStats() const;
+    void resetRebuildStats();
+    void setBuildThreads(int threads);
+    string name() const override;
+
+    friend class NearestTaxiIterator;
 };
 
 #endif
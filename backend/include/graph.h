@@ -7,6 +7,8 @@
 #include <utility>
 #include <cstddef>
 #include <functional>
+#include <memory>
+#include <string>
 
 using namespace std;
 
@@ -18,9 +20,41 @@ struct PairHash {
     }
 };
 
+// A grid path kept as its first cell and straight runs: each run moves
+// length cells by (dx, dy). A route with t turns takes t + 1 runs however
+// many cells it covers.
+struct PathRun {
+    signed char dx, dy;
+    int length;
+};
+
+struct RunLengthPath {
+    pair<int, int> start;
+    vector<PathRun> runs;
+
+    RunLengthPath() : start(0, 0) {}
+    explicit RunLengthPath(pair<int, int> start) : start(start) {}
+
+    // Extends the last run when the direction matches, else opens a new one.
+    void step(int dx, int dy);
+    int length() const;
+    pair<int, int> end() const;
+    RunLengthPath reversed() const;
+
+    // Polyline vertices: start, every corner, end.
+    vector<pair<int, int>> turnPoints() const;
+    // Every cell along the way, start included.
+    vector<pair<int, int>> expand() const;
+};
+
+class LandmarkTable;
+
 class GridGraph {
 private:
+    friend class LandmarkTable;
+
     unordered_map<pair<int, int>, vector<pair<int, int>>, PairHash> adjacencyList;
+    shared_ptr<const LandmarkTable> landmarks;
     const int MIN_COORD = -100;
     const int MAX_COORD = 100;
     mt19937 rng;
@@ -28,6 +62,7 @@ private:
     bool isValid(int x, int y) const;
     void addEdge(const pair<int, int>& node1, const pair<int, int>& node2);
     bool hasEdge(const pair<int, int>& node1, const pair<int, int>& node2) const;
+    static RunLengthPath manhattanPath(pair<int, int> start, pair<int, int> end);
 
 public:
     GridGraph();
@@ -35,8 +70,16 @@ public:
     void buildSparseGraph(const vector<pair<int,int>>& taxi_locations, pair<int,int> pickup);
     void createManhattanPath(pair<int,int> from, pair<int,int> to);
     vector<pair<pair<int,int>, pair<int,int>>> getAllEdges() const;
-    vector<pair<int, int>> dijkstraPath(pair<int, int> start, pair<int, int> end);
-    int dijkstra(pair<int, int> start, pair<int, int> end);
+    RunLengthPath dijkstraPath(pair<int, int> start, pair<int, int> end) const;
+    int dijkstra(pair<int, int> start, pair<int, int> end) const;
+
+    // Landmark (ALT) preprocessing; while a table is present dijkstra and
+    // dijkstraPath run A* on it. Adding an edge drops the table.
+    void buildLandmarks(int count);
+    bool saveLandmarks(const string& path) const;
+    bool loadLandmarks(const string& path);
+    bool hasLandmarks() const;
+    int lowerBound(pair<int, int> start, pair<int, int> end) const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,55 @@
+#ifndef GRID_INDEX_H
+#define GRID_INDEX_H
+
+#include "spatial_index.h"
+#include <vector>
+#include <queue>
+#include <utility>
+using namespace std;
+
+// Uniform grid of cell buckets over a bounded domain. Moves are O(1) and kNN
+// expands square rings of cells around the query until the k-th distance is
+// closer than any unvisited ring. Points outside the domain are clamped into
+// the border cells but keep their exact coordinates.
+class UniformGridIndex : public SpatialIndex {
+private:
+    struct Entry {
+        point p;
+        TaxiAttributes attr;
+    };
+
+    int minCoord;
+    int maxCoord;
+    int cellSize;
+    int cellsPerSide;
+    vector<vector<Entry>> cells;
+    int count;
+
+    int cellCoord(int v) const;
+    int cellIndex(const point& p) const;
+    Entry* find(const point& p);
+    void scanCell(int cx, int cy, const point& query, int k, const TaxiFilter& filter,
+                  priority_queue<pair<double, int>>& pq, vector<point>& candidates);
+
+public:
+    UniformGridIndex(int minCoord = -100, int maxCoord = 100, int cellSize = 8);
+
+    void buildFromVector(const vector<point>& points) override;
+    void buildFromVector(const vector<point>& points, const vector<TaxiAttributes>& attrs) override;
+    void insert(const point& p) override;
+    void insert(const point& p, const TaxiAttributes& attr) override;
+    bool deletePoint(const point& p) override;
+    bool search(const point& p) override;
+    vector<point> kNearestNeighbors(const point& query, int k) override;
+    vector<point> kNearestNeighbors(const point& query, int k, const TaxiFilter& filter) override;
+    bool setAttributes(const point& p, const TaxiAttributes& attr) override;
+    bool getAttributes(const point& p, TaxiAttributes& attr) override;
+    vector<point> rangeSearch(const point& low, const point& high) override;
+    int getHeight() override;
+    int size() override;
+    void getAllPoints(vector<point>& points) override;
+    void getAllTaxis(vector<pair<point, TaxiAttributes>>& taxis) override;
+    string name() const override;
+};
+
+#endif
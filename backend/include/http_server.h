@@ -0,0 +1,117 @@
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include "taxi_engine.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+struct HttpServerConfig {
+    int port;
+    int workers;
+    size_t readBufferSize;   // largest request (headers + body) accepted
+    size_t writeBufferSize;  // initial capacity of each response buffer
+    size_t maxConnections;
+    size_t maxRequestsPerWakeup;  // pipelined requests served per connection per pass
+
+    HttpServerConfig()
+        : port(8002), workers(4), readBufferSize(16 * 1024), writeBufferSize(256 * 1024),
+          maxConnections(1024), maxRequestsPerWakeup(64) {}
+};
+
+// Serves the same endpoints as server.js straight from the engine:
+// POST /api/route, /api/book-taxi, /api/start-ride and /api/dispatch, plus
+// GET /health and /metrics. POST /api/subscribe, /api/subscription (poll)
+// and /api/unsubscribe manage standing kNN queries, which no server.js
+// route has. One edge-triggered epoll loop owns every socket
+// and parses requests; a small worker pool runs the engine calls and hands
+// responses back through an eventfd. Connections are kept alive and their
+// buffers are allocated once and recycled. Linux only.
+class HttpServer {
+private:
+    struct Connection {
+        int fd;
+        unsigned generation;
+        vector<char> readBuffer;
+        size_t readLength;
+        string writeBuffer;
+        size_t writeOffset;
+        bool busy;
+        bool closeAfterWrite;
+        unsigned served;
+    };
+
+    struct Job {
+        int fd;
+        unsigned generation;
+        string method;
+        string path;
+        string body;
+        bool keepAlive;
+    };
+
+    struct Completion {
+        int fd;
+        unsigned generation;
+        string response;
+        bool keepAlive;
+    };
+
+    TaxiEngine& engine;
+    HttpServerConfig config;
+
+    int listenFd;
+    int epollFd;
+    int wakeFd;
+    atomic<bool> running;
+
+    unordered_map<int, Connection*> connections;
+    vector<unique_ptr<Connection>> connectionPool;
+    vector<Connection*> freeConnections;
+    vector<pair<int, unsigned>> deferred;  // (fd, generation) to resume next pass
+    unsigned nextGeneration;
+
+    mutex jobLock;
+    condition_variable jobReady;
+    deque<Job> jobs;
+    mutex completionLock;
+    vector<Completion> completions;
+    vector<thread> workers;
+
+    atomic<size_t> requests;
+    atomic<size_t> errors;
+    atomic<size_t> accepted;
+    atomic<size_t> active;
+    atomic<size_t> keepAliveReuses;
+
+    Connection* acquireConnection(int fd);
+    void closeConnection(Connection* conn);
+    void acceptAll();
+    bool readAll(Connection* conn);
+    void parseRequest(Connection* conn);
+    void respond(Connection* conn, const string& response, bool keepAlive);
+    bool flush(Connection* conn);
+    void service(Connection* conn);
+    void drainCompletions();
+    void workerLoop();
+    string handle(const Job& job, int& status);
+    string metricsJson();
+    static string httpResponse(int status, const string& body, bool keepAlive);
+
+public:
+    HttpServer(TaxiEngine& engine, const HttpServerConfig& config = HttpServerConfig());
+    ~HttpServer();
+
+    bool start();
+    void run();
+    void stop();
+};
+
+#endif
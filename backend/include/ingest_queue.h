@@ -0,0 +1,87 @@
+#ifndef INGEST_QUEUE_H
+#define INGEST_QUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+// Bounded lock-free ring (Vyukov-style sequence slots). Any number of
+// producers may call tryPush concurrently; only one thread may call tryPop.
+template <typename T>
+class IngestQueue {
+private:
+    struct Slot {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    vector<Slot> slots;
+    size_t mask;
+    alignas(64) atomic<size_t> tail;
+    alignas(64) atomic<size_t> head;
+
+    static size_t roundUpPow2(size_t n) {
+        size_t cap = 2;
+        while (cap < n) cap <<= 1;
+        return cap;
+    }
+
+public:
+    explicit IngestQueue(size_t capacity)
+        : slots(roundUpPow2(capacity)), mask(roundUpPow2(capacity) - 1), tail(0), head(0) {
+        for (size_t i = 0; i < slots.size(); i++) {
+            slots[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+
+    IngestQueue(const IngestQueue&) = delete;
+    IngestQueue& operator=(const IngestQueue&) = delete;
+
+    bool tryPush(const T& item) {
+        size_t pos = tail.load(memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[pos & mask];
+            size_t seq = slot.sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    slot.value = item;
+                    slot.sequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& item) {
+        size_t pos = head.load(memory_order_relaxed);
+        Slot& slot = slots[pos & mask];
+        size_t seq = slot.sequence.load(memory_order_acquire);
+
+        if ((intptr_t)seq - (intptr_t)(pos + 1) < 0) return false;
+
+        item = slot.value;
+        slot.sequence.store(pos + mask + 1, memory_order_release);
+        head.store(pos + 1, memory_order_relaxed);
+        return true;
+    }
+
+    size_t size() const {
+        size_t t = tail.load(memory_order_relaxed);
+        size_t h = head.load(memory_order_relaxed);
+        return t > h ? t - h : 0;
+    }
+
+    size_t capacity() const {
+        return slots.size();
+    }
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef INGEST_WRITER_H
+#define INGEST_WRITER_H
+
+#include "spatial_index.h"
+#include "ingest_queue.h"
+#include "point.h"
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+enum class UpdateKind {
+    MOVE,
+    REMOVE
+};
+
+// hasAttr marks a move that brings its attributes along, for a taxi the
+// writer has not seen yet (one migrating in from another shard); other
+// moves keep whatever the taxi already has.
+struct TaxiUpdate {
+    int taxiId;
+    point pos;
+    UpdateKind kind;
+    bool hasAttr;
+    TaxiAttributes attr;
+
+    TaxiUpdate() : taxiId(-1), pos(0, 0), kind(UpdateKind::MOVE), hasAttr(false) {}
+    TaxiUpdate(int id, const point& p, UpdateKind k = UpdateKind::MOVE)
+        : taxiId(id), pos(p), kind(k), hasAttr(false) {}
+    TaxiUpdate(int id, const point& p, const TaxiAttributes& attr)
+        : taxiId(id), pos(p), kind(UpdateKind::MOVE), hasAttr(true), attr(attr) {}
+};
+
+// A tracked taxi as the writer sees it, with the attributes of its cell.
+struct TrackedTaxi {
+    int taxiId;
+    point pos;
+    TaxiAttributes attr;
+
+    TrackedTaxi(int id, const point& p, const TaxiAttributes& attr) : taxiId(id), pos(p), attr(attr) {}
+};
+
+struct IngestMetrics {
+    size_t enqueued;
+    size_t rejected;
+    size_t applied;  // updates that changed the index
+    size_t coalesced;
+    size_t batches;
+    size_t queueDepth;
+    size_t maxQueueDepth;
+    size_t capacity;
+};
+
+// Serializes GPS updates from many producer threads into one SpatialIndex.
+// Producers only touch the lock-free ring; the writer thread drains it in
+// batches, keeps the latest position per taxi and applies the survivors.
+class IngestWriter {
+private:
+    SpatialIndex& index;
+    IngestQueue<TaxiUpdate> queue;
+    size_t batchSize;
+
+    thread writer;
+    atomic<bool> running;
+    mutex indexMutex;
+
+    unordered_map<int, point> taxiPositions;
+    unordered_map<long long, int> occupancy;
+    unordered_set<long long> anonymous;  // cells held by points with no taxi id
+
+    atomic<size_t> enqueued;
+    atomic<size_t> rejected;
+    atomic<size_t> applied;
+    atomic<size_t> coalesced;
+    atomic<size_t> batches;
+    atomic<size_t> maxQueueDepth;
+
+    void writerLoop();
+    size_t drainBatch(vector<TaxiUpdate>& batch);
+    void applyBatch(const vector<TaxiUpdate>& batch);
+    bool applyUpdate(const TaxiUpdate& update);
+    void placeTaxi(const point& p, const TaxiAttributes& attr);
+    void removeTaxi(const point& p);
+
+public:
+    IngestWriter(SpatialIndex& index, size_t capacity = 1 << 16, size_t batchSize = 1024);
+    ~IngestWriter();
+
+    void start();
+    void stop();
+
+    bool submit(const TaxiUpdate& update);
+    bool submit(int taxiId, const point& pos);
+    bool submitRemove(int taxiId);
+
+    void applyNow(const TaxiUpdate& update);
+    void applyNow(const TrackedTaxi& taxi);
+
+    // Points already in the index when the writer is built hold their cells
+    // with no taxi id. Binding one to an id makes that taxi's updates move
+    // it; without the binding a first move would leave it behind. Fails if
+    // the id is already tracked or no point is at p.
+    bool bindTaxi(int taxiId, const point& p);
+
+    // Points without a taxi id, as in a plain SpatialIndex. Each holds its
+    // cell like a taxi does, so taxis passing through never delete it, and
+    // it only leaves through deletePoint.
+    void insertPoint(const point& p);
+    void insertPoint(const point& p, const TaxiAttributes& attr);
+    bool deletePoint(const point& p);
+
+    vector<TrackedTaxi> taxiSnapshot();
+    bool attributesOf(int taxiId, TaxiAttributes& attr);
+    void anonymousSnapshot(vector<pair<point, TaxiAttributes>>& points);
+
+    void withIndex(const function<void(SpatialIndex&)>& fn);
+    vector<point> kNearestNeighbors(const point& query, int k, const TaxiFilter& filter = TaxiFilter::any());
+
+    IngestMetrics metrics() const;
+};
+
+#endif
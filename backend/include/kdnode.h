@@ -2,6 +2,8 @@
 #define KDNODE_H
 
 #include "point.h"
+#include "taxi_attributes.h"
+#include <climits>
 
 class KDNode {
 public:
@@ -9,12 +11,47 @@ public:
     KDNode* left;
     KDNode* right;
     int height;
+    TaxiAttributes attr;
 
-    KDNode() : p(0, 0), left(nullptr), right(nullptr), height(1) {}
+    // Tombstoned nodes keep routing searches but hold no taxi.
+    bool deleted;
+    int subtreeSize;
+    int deadCount;
 
-    KDNode(int x, int y) : p(x, y), left(nullptr), right(nullptr), height(1) {}
+    // Subtree aggregates used to skip subtrees with no matching taxi.
+    int availableCount;
+    unsigned classMask;
+    int maxCapacity;
+
+    // Tight bounding box of every live point in the subtree; empty
+    // (min > max) when the subtree holds only tombstones.
+    int minX, minY, maxX, maxY;
+
+    KDNode() : p(0, 0), left(nullptr), right(nullptr), height(1), deleted(false) { resetAggregates(); }
+
+    KDNode(int x, int y) : p(x, y), left(nullptr), right(nullptr), height(1), deleted(false) { resetAggregates(); }
     KDNode(const point& point) 
-        : p(point), left(nullptr), right(nullptr), height(1) {}
+        : p(point), left(nullptr), right(nullptr), height(1), deleted(false) { resetAggregates(); }
+    KDNode(const point& point, const TaxiAttributes& attr)
+        : p(point), left(nullptr), right(nullptr), height(1), attr(attr), deleted(false) { resetAggregates(); }
+
+    void resetAggregates() {
+        subtreeSize = 1;
+        deadCount = deleted ? 1 : 0;
+        if (deleted) {
+            availableCount = 0;
+            classMask = 0;
+            maxCapacity = INT_MIN;
+            minX = minY = INT_MAX;
+            maxX = maxY = INT_MIN;
+            return;
+        }
+        availableCount = attr.available() ? 1 : 0;
+        classMask = attr.classBit();
+        maxCapacity = attr.capacity;
+        minX = maxX = p.x;
+        minY = maxY = p.y;
+    }
 
     bool operator==(const KDNode& other) const {
         return p == other.p && height == other.height;
@@ -0,0 +1,75 @@
+#ifndef KNN_SUBSCRIPTIONS_H
+#define KNN_SUBSCRIPTIONS_H
+
+#include "spatial_index.h"
+#include "taxi_attributes.h"
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+struct KnnDelta {
+    int subscriptionId;
+    vector<point> added;
+    vector<point> removed;
+};
+
+// Standing k-nearest queries for waiting riders. Callers apply taxi changes
+// to the index first and then report them here; only subscriptions whose
+// current k-th distance (the safe radius) is crossed are touched, and each
+// returns the taxis that entered or left its answer.
+class KnnSubscriptionManager {
+private:
+    struct Subscription {
+        int id;
+        point pickup;
+        int k;
+        TaxiFilter filter;
+        vector<point> current;
+        double radius;
+        bool unbounded;
+        int cellX0, cellY0, cellX1, cellY1;
+
+        Subscription() : id(-1), pickup(0, 0), k(0), radius(0), unbounded(true),
+                         cellX0(0), cellY0(0), cellX1(-1), cellY1(-1) {}
+    };
+
+    SpatialIndex& index;
+    int cellSize;
+    int nextId;
+    unordered_map<int, Subscription> subscriptions;
+    unordered_map<long long, vector<int>> cellSubscriptions;
+    unordered_map<long long, vector<int>> memberSubscriptions;
+    vector<int> unboundedSubscriptions;
+    size_t recomputations;
+    size_t incrementalUpdates;
+
+    static void eraseId(vector<int>& ids, int id);
+    int cellOf(int v) const;
+    void registerSubscription(Subscription& sub);
+    void unregisterSubscription(Subscription& sub);
+    void refreshRadius(Subscription& sub);
+    void recompute(Subscription& sub);
+    bool contains(const Subscription& sub, const point& p) const;
+    bool eligible(const Subscription& sub, const point& p);
+    bool update(Subscription& sub, const point* from, const point* to, KnnDelta& delta);
+    vector<KnnDelta> process(const point* from, const point* to);
+
+public:
+    KnnSubscriptionManager(SpatialIndex& index, int cellSize = 16);
+
+    int subscribe(const point& pickup, int k, const TaxiFilter& filter = TaxiFilter::available());
+    void unsubscribe(int id);
+    bool hasSubscription(int id) const;
+    vector<point> current(int id) const;
+    size_t subscriptionCount() const;
+
+    vector<KnnDelta> onTaxiMoved(const point& from, const point& to);
+    vector<KnnDelta> onTaxiAdded(const point& at);
+    vector<KnnDelta> onTaxiRemoved(const point& from);
+    vector<KnnDelta> onTaxiStatusChanged(const point& at);
+
+    size_t recomputationCount() const;
+    size_t incrementalUpdateCount() const;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef LANDMARKS_H
+#define LANDMARKS_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "graph.h"
+using namespace std;
+
+// ALT preprocessing for a GridGraph: road distances from a few landmarks to
+// every node. By the triangle inequality |d(L,a) - d(L,b)| <= d(a,b) for each
+// landmark L, so the largest such difference (or the Manhattan distance,
+// whichever is larger) is a lower bound on the road distance that follows
+// detours and dead ends the Manhattan estimate cannot see.
+//
+// Landmarks are picked farthest-point first: each new one is the node whose
+// road distance to the landmarks chosen so far is largest, which puts them
+// on the edges of the network where the bounds are tightest. A landmark that
+// reaches only one of two nodes proves they are not connected.
+//
+// The table belongs to one graph; any new edge can shorten distances and
+// invalidate it, which is why GridGraph drops its table on addEdge.
+class LandmarkTable {
+private:
+    static const uint16_t UNREACHABLE = 0xFFFF;
+    static const uint16_t FARTHEST = 0xFFFE;
+
+    vector<pair<int, int>> nodes;  // sorted, so a graph always maps the same way
+    int originX, originY, width, height;
+    vector<int> cells;             // node index per bounding-box cell, if dense enough
+    vector<int> offsets;           // CSR adjacency over node indexes
+    vector<int> targets;
+    vector<int> landmarks;
+    vector<uint16_t> distances;    // node-major: distances[v * landmarks + l]
+    unsigned long long graphHash;
+
+    struct SearchScratch {
+        vector<int> dist;
+        vector<int> previous;
+        vector<unsigned> seen;    // dist and previous hold for this search
+        vector<unsigned> closed;
+        vector<pair<int, int>> open;
+        unsigned stamp = 0;
+
+        void begin(size_t n);
+        int distance(int v) const;
+        void reach(int v, int d, int from);
+    };
+    static thread_local SearchScratch searchScratch;
+
+    void indexGraph(const GridGraph& graph);
+    void breadthFirst(int source, vector<int>& dist) const;
+    int bound(int from, int to) const;
+    int lookup(const pair<int, int>& node) const;
+
+public:
+    LandmarkTable();
+
+    void build(const GridGraph& graph, int count);
+
+    // Binary file: "ALT1", graph fingerprint, node and landmark counts, the
+    // landmark node indexes and the distance table as 16-bit values. Node
+    // coordinates are not stored; load re-derives them from the graph and
+    // refuses a table whose fingerprint does not match it.
+    bool save(const string& path) const;
+    bool load(const string& path, const GridGraph& graph);
+
+    // max(Manhattan, ALT) bound on the road distance; the Manhattan distance
+    // alone for nodes outside the table.
+    int lowerBound(const pair<int, int>& from, const pair<int, int>& to) const;
+
+    // A* driven by lowerBound. Returns the road distance and fills path when
+    // given, or -1 if no road connects the two nodes.
+    int search(const pair<int, int>& from, const pair<int, int>& to, RunLengthPath* path) const;
+
+    int landmarkCount() const;
+    size_t nodeCount() const;
+    vector<pair<int, int>> getLandmarks() const;
+
+    static unsigned long long fingerprint(const GridGraph& graph);
+};
+
+#endif
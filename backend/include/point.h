@@ -3,6 +3,13 @@
 
 #include <cmath>
 
+// Both coordinates in one hash key. Goes through unsigned so negative
+// coordinates neither shift into undefined behaviour nor sign-extend
+// over the high half.
+inline long long packCoords(int x, int y) {
+    return (long long)(((unsigned long long)(unsigned int)x << 32) | (unsigned int)y);
+}
+
 struct point {
     int x;
     int y;
@@ -21,6 +28,10 @@ struct point {
     double distance(const point& other) const {
         return std::sqrt(distanceSquared(other));
     }
+
+    long long key() const {
+        return packCoords(x, y);
+    }
 };
 
 #endif 
\ No newline at end of file
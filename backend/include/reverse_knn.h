@@ -0,0 +1,74 @@
+#ifndef REVERSE_KNN_H
+#define REVERSE_KNN_H
+
+#include "dynamic_kd_tree.h"
+#include "spatial_index.h"
+#include "taxi_attributes.h"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Reverse k-NN over waiting riders: given a taxi position, which riders
+// would have it among their k nearest matching taxis? Each rider keeps the
+// distance to its current k-th taxi (its radius); the taxi joins a rider's
+// set exactly when it is closer than that.
+//
+// Pickups live in DynamicKDTrees bucketed by radius band, band b holding
+// radii below 2^b. A query runs one square range search per band, of
+// half-width 2^b around the taxi, so it only touches riders close enough
+// that their radius could reach it. Riders with fewer than k taxis in reach
+// are joined by any taxi and kept aside.
+class ReverseKnnIndex {
+private:
+    static const int BANDS = 32;
+
+    struct Rider {
+        point pickup;
+        double radiusSquared;
+        bool unbounded;
+        int band;
+
+        Rider() : pickup(0, 0), radiusSquared(0), unbounded(true), band(-1) {}
+    };
+
+    SpatialIndex& taxis;
+    int k;
+    TaxiFilter filter;
+    int nextId;
+    unordered_map<int, Rider> riders;
+    unique_ptr<DynamicKDTree> bands[BANDS];
+    unordered_map<long long, vector<int>> bandRiders[BANDS];
+    int bandSizes[BANDS];
+    vector<int> unboundedRiders;
+    size_t examined;
+
+    static int bandOf(double radiusSquared);
+    static void eraseId(vector<int>& ids, int id);
+    void place(int id, Rider& rider);
+    void unplace(int id, Rider& rider);
+    void refresh(int id);
+    vector<int> reachedBy(const point& taxi, bool inclusive);
+
+public:
+    ReverseKnnIndex(SpatialIndex& taxis, int k = 5, const TaxiFilter& filter = TaxiFilter::available());
+
+    int addRider(const point& pickup);
+    bool removeRider(int id);
+    size_t riderCount() const;
+    double radius(int id) const;
+
+    // Riders whose k nearest taxis this one would now be part of.
+    vector<int> ridersJoinedBy(const point& taxi);
+
+    // Keep radii current after the taxi index changed: a taxi that became
+    // available shrinks the radius of the riders it joins (returned), one
+    // that was taken or removed grows the radius of riders that counted it.
+    vector<int> onTaxiAvailable(const point& taxi);
+    void onTaxiUnavailable(const point& taxi);
+
+    // Riders checked against their radius so far, answers included.
+    size_t candidatesExamined() const;
+};
+
+#endif
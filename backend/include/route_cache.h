@@ -0,0 +1,92 @@
+#ifndef ROUTE_CACHE_H
+#define ROUTE_CACHE_H
+
+#include "point.h"
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+using namespace std;
+
+struct RouteCacheMetrics {
+    size_t hits;
+    size_t misses;
+    size_t invalidations;
+    size_t evictions;
+    size_t regionBumps;
+    size_t entries;
+    size_t bytes;
+};
+
+// What a route answer was computed against: its pickup cell and k, and the
+// versions of the regions its kNN disk overlapped at that moment. Taken
+// together with the kNN, before the answer is built, so a change landing
+// while the answer is serialized still invalidates it.
+struct RouteCacheStamp {
+    int cellX, cellY, k;
+    bool global;
+    unsigned long long globalVersion;
+    vector<pair<long long, unsigned long long>> regions;
+};
+
+// Route responses keyed by pickup cell and k. Each entry remembers the
+// version of every region its kNN disk overlapped; a taxi change bumps only
+// the region it happened in, and an entry is dropped on lookup once any of
+// its regions has moved on. Answers with fewer than k taxis depend on the
+// whole plane and are tied to a global version instead.
+//
+// With cellSize 1 (the default) the key is the exact pickup; larger cells
+// serve every pickup in the cell the response computed for the first one.
+//
+// The capacity is in bytes, not entries: a route response carries its whole
+// road network and runs to hundreds of kilobytes, so a count alone says
+// little about memory. Least recently used entries go first.
+class RouteCache {
+private:
+    struct Entry {
+        long long key;
+        int cellX, cellY, k;
+        string response;
+        bool global;
+        unsigned long long globalVersion;
+        vector<pair<long long, unsigned long long>> regions;
+        size_t bytes;
+    };
+
+    int cellSize;
+    int regionSize;
+    size_t capacity;
+    size_t bytes;
+
+    mutable mutex lock;
+    list<Entry> entries;
+    unordered_map<long long, list<Entry>::iterator> index;
+    unordered_map<long long, unsigned long long> regionVersions;
+    unsigned long long globalVersion;
+
+    size_t hits;
+    size_t misses;
+    size_t invalidations;
+    size_t evictions;
+    size_t regionBumps;
+
+    static int floorDiv(int v, int size);
+    long long keyFor(int cellX, int cellY, int k) const;
+    unsigned long long versionOf(long long region) const;
+    bool valid(const Entry& entry) const;
+    void erase(list<Entry>::iterator it);
+
+public:
+    RouteCache(int cellSize = 1, int regionSize = 16, size_t capacity = 64 * 1024 * 1024);
+
+    bool lookup(const point& pickup, int k, string& response);
+    RouteCacheStamp stamp(const point& pickup, int k, double radius) const;
+    void store(const RouteCacheStamp& stamp, const string& response);
+    void onTaxiChanged(const point& at);
+    void clear();
+    RouteCacheMetrics metrics() const;
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef SHARDED_INDEX_H
+#define SHARDED_INDEX_H
+
+#include "spatial_index.h"
+#include "dynamic_kd_tree.h"
+#include "ingest_writer.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <utility>
+using namespace std;
+
+struct ShardConfig {
+    int cols;
+    int rows;
+    int minCoord;
+    int maxCoord;
+    int maxTaxis;
+    size_t queueCapacity;
+    size_t batchSize;
+
+    // flush() rebalances once the largest shard holds more than
+    // rebalanceSkew times the mean and the fleet has at least
+    // rebalanceMinTaxis points; a skew of 0 leaves it to the caller.
+    double rebalanceSkew;
+    int rebalanceMinTaxis;
+
+    // Optional explicit tile boundaries: cols-1 x splits and, per column,
+    // rows-1 y splits. Left empty, tiles split the domain evenly.
+    vector<int> xSplits;
+    vector<vector<int>> ySplits;
+
+    ShardConfig()
+        : cols(2), rows(2), minCoord(-100), maxCoord(100), maxTaxis(1 << 16),
+          queueCapacity(1 << 14), batchSize(1024), rebalanceSkew(2.0), rebalanceMinTaxis(1024) {}
+};
+
+struct ShardStats {
+    int minX, maxX, minY, maxY;
+    int size;
+    IngestMetrics ingest;
+};
+
+// Partitions the plane into cols x rows tiles, each owning a DynamicKDTree
+// and its own IngestWriter thread. Taxi updates are routed by position and
+// migrate between shards when a taxi crosses a tile edge. kNN asks the home
+// tile first and only fans out to tiles closer than the current k-th distance.
+//
+// buildFromVector, flush, rebalance and rebalanceIfSkewed may rebuild every
+// shard and must not run concurrently with submit or queries.
+class ShardedIndex : public SpatialIndex {
+private:
+    struct Shard {
+        int minX, maxX, minY, maxY;
+        unique_ptr<DynamicKDTree> tree;
+        unique_ptr<IngestWriter> writer;
+    };
+
+    ShardConfig config;
+    vector<int> xSplits;
+    vector<vector<int>> ySplits;
+    vector<Shard> shards;
+    vector<atomic<int>> taxiShard;
+    atomic<size_t> migrations;
+
+    int shardFor(const point& p) const;
+    double tileDistance(const Shard& shard, const point& query) const;
+    void layoutUniform();
+    void layoutFromPoints(vector<point> points);
+    void populate(const vector<pair<point, TaxiAttributes>>& anonymous,
+                  const vector<TrackedTaxi>& taxis);
+    void startWriters();
+    void stopWriters();
+
+public:
+    ShardedIndex(const ShardConfig& config = ShardConfig());
+    ~ShardedIndex();
+
+    // Gives a point loaded by buildFromVector a taxi id, so the taxi's
+    // first update moves it. Call before submitting updates for that id.
+    bool bindTaxi(int taxiId, const point& p);
+    bool submit(int taxiId, const point& pos);
+    bool submitRemove(int taxiId);
+    void flush();
+
+    void rebalance();
+    bool rebalanceIfSkewed(double maxSkew);
+    vector<ShardStats> shardStats();
+    size_t migrationCount() const;
+    int shardCount() const;
+
+    void buildFromVector(const vector<point>& points) override;
+    void buildFromVector(const vector<point>& points, const vector<TaxiAttributes>& attrs) override;
+    void insert(const point& p) override;
+    void insert(const point& p, const TaxiAttributes& attr) override;
+    bool deletePoint(const point& p) override;
+    bool search(const point& p) override;
+    vector<point> kNearestNeighbors(const point& query, int k) override;
+    vector<point> kNearestNeighbors(const point& query, int k, const TaxiFilter& filter) override;
+    bool setAttributes(const point& p, const TaxiAttributes& attr) override;
+    bool getAttributes(const point& p, TaxiAttributes& attr) override;
+    vector<point> rangeSearch(const point& low, const point& high) override;
+    int getHeight() override;
+    int size() override;
+    void getAllPoints(vector<point>& points) override;
+    void getAllTaxis(vector<pair<point, TaxiAttributes>>& taxis) override;
+    string name() const override;
+};
+
+#endif
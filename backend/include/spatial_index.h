@@ -0,0 +1,86 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include "point.h"
+#include "taxi_attributes.h"
+#include <vector>
+#include <memory>
+#include <string>
+#include <utility>
+using namespace std;
+
+// Limits that trade exactness for speed in a k-NN search. With epsilon > 0 a
+// subtree is skipped unless it could hold a taxi more than (1 + epsilon)
+// times closer than the current k-th, so each returned distance is within
+// that factor of the true one. maxNodes > 0 stops after visiting that many
+// nodes and returns the best found so far.
+struct KnnOptions {
+    double epsilon;
+    int maxNodes;
+
+    KnnOptions(double epsilon = 0.0, int maxNodes = 0) : epsilon(epsilon), maxNodes(maxNodes) {}
+};
+
+// approximate is set when the limits actually cut the search short, so the
+// points may differ from the exact answer.
+struct KnnResult {
+    vector<point> points;
+    bool approximate;
+    int nodesVisited;
+
+    KnnResult() : approximate(false), nodesVisited(0) {}
+};
+
+// A rows x cols grid of equal zones; zone (col, row) covers
+// [origin.x + col * cellWidth, origin.x + (col + 1) * cellWidth) and the
+// same along y. Counts come back row-major.
+struct ZoneGrid {
+    point origin;
+    int cellWidth;
+    int cellHeight;
+    int cols;
+    int rows;
+
+    ZoneGrid(const point& origin, int cellWidth, int cellHeight, int cols, int rows)
+        : origin(origin), cellWidth(cellWidth), cellHeight(cellHeight), cols(cols), rows(rows) {}
+
+    bool valid() const {
+        return cellWidth > 0 && cellHeight > 0 && cols > 0 && rows > 0;
+    }
+};
+
+// Operations the booking engine needs from a taxi position index.
+class SpatialIndex {
+public:
+    virtual ~SpatialIndex() {}
+
+    virtual void buildFromVector(const vector<point>& points) = 0;
+    virtual void buildFromVector(const vector<point>& points, const vector<TaxiAttributes>& attrs) = 0;
+    virtual void insert(const point& p) = 0;
+    virtual void insert(const point& p, const TaxiAttributes& attr) = 0;
+    virtual bool deletePoint(const point& p) = 0;
+    virtual bool search(const point& p) = 0;
+    virtual vector<point> kNearestNeighbors(const point& query, int k) = 0;
+    virtual vector<point> kNearestNeighbors(const point& query, int k, const TaxiFilter& filter) = 0;
+    // Indexes without an approximate search answer exactly.
+    virtual KnnResult kNearestNeighbors(const point& query, int k, const TaxiFilter& filter,
+                                        const KnnOptions& options);
+    virtual bool setAttributes(const point& p, const TaxiAttributes& attr) = 0;
+    virtual bool getAttributes(const point& p, TaxiAttributes& attr) = 0;
+    virtual vector<point> rangeSearch(const point& low, const point& high) = 0;
+    // Taxis inside the rectangle / per zone, optionally only available ones.
+    // The defaults collect the points; indexes with subtree counts override.
+    virtual int rangeCount(const point& low, const point& high, bool availableOnly = false);
+    virtual vector<int> zoneCounts(const ZoneGrid& grid, bool availableOnly = false);
+    virtual int getHeight() = 0;
+    virtual int size() = 0;
+    virtual void getAllPoints(vector<point>& points) = 0;
+    virtual void getAllTaxis(vector<pair<point, TaxiAttributes>>& taxis) = 0;
+    virtual string name() const = 0;
+};
+
+// kind is "kdtree" (default), "kdtree-lazy" (tombstone deletes), "compact"
+// (array-backed KD-tree) or "grid"; unknown kinds fall back to the KD-tree.
+unique_ptr<SpatialIndex> makeSpatialIndex(const string& kind);
+
+#endif
@@ -2,6 +2,7 @@
 #define TAXI_H
 
 #include "point.h"
+#include "graph.h"
 #include <vector>
 #include <utility>
 
@@ -9,13 +10,12 @@ struct TaxiInfo {
     point node;
     double euclideanDist;
     int graphDist;
-    vector<pair<int,int>> path;
+    RunLengthPath path;
 
     TaxiInfo() : 
         node({0, 0}), 
         euclideanDist(0.0), 
-        graphDist(0), 
-        path({})         
+        graphDist(0)
     {}
 };
 
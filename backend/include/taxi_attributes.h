@@ -0,0 +1,56 @@
+#ifndef TAXI_ATTRIBUTES_H
+#define TAXI_ATTRIBUTES_H
+
+enum class TaxiStatus {
+    AVAILABLE = 0,
+    BOOKED = 1,
+    ON_RIDE = 2,
+    OFFLINE = 3
+};
+
+struct TaxiAttributes {
+    TaxiStatus status;
+    int vehicleClass;  // 0..31, used as a bit in subtree class masks
+    int capacity;
+
+    TaxiAttributes(TaxiStatus status = TaxiStatus::AVAILABLE, int vehicleClass = 0, int capacity = 4)
+        : status(status), vehicleClass(vehicleClass), capacity(capacity) {}
+
+    bool available() const {
+        return status == TaxiStatus::AVAILABLE;
+    }
+
+    unsigned classBit() const {
+        return 1u << (vehicleClass & 31);
+    }
+};
+
+// Which taxis a search may return. vehicleClass < 0 accepts any class.
+struct TaxiFilter {
+    bool availableOnly;
+    int vehicleClass;
+    int minCapacity;
+
+    TaxiFilter(bool availableOnly = false, int vehicleClass = -1, int minCapacity = 0)
+        : availableOnly(availableOnly), vehicleClass(vehicleClass), minCapacity(minCapacity) {}
+
+    static TaxiFilter any() {
+        return TaxiFilter();
+    }
+
+    static TaxiFilter available(int vehicleClass = -1, int minCapacity = 0) {
+        return TaxiFilter(true, vehicleClass, minCapacity);
+    }
+
+    bool matches(const TaxiAttributes& attr) const {
+        if (availableOnly && !attr.available()) return false;
+        if (vehicleClass >= 0 && attr.vehicleClass != vehicleClass) return false;
+        return attr.capacity >= minCapacity;
+    }
+
+    bool isAny() const {
+        return !availableOnly && vehicleClass < 0 && minCapacity <= 0;
+    }
+};
+
+#endif
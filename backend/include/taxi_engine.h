@@ -0,0 +1,67 @@
+#ifndef TAXI_ENGINE_H
+#define TAXI_ENGINE_H
+
+#include "spatial_index.h"
+#include "graph.h"
+#include "knn_subscriptions.h"
+#include "route_cache.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// The request handlers behind the API: loads the fleet from the state file,
+// answers route, booking and dispatch requests as JSON strings and writes
+// the fleet back after every change. Route answers go through a RouteCache
+// that booking and dispatch invalidate region by region. Routes rank all k
+// candidates by road distance and list the best five. Waiting riders can
+// hold a standing kNN subscription instead; every booking and dispatch
+// reports its moves to it, and the added/removed taxis collect until the
+// rider polls.
+class TaxiEngine {
+private:
+    unique_ptr<SpatialIndex> index;
+    string stateFile;
+    RouteCache cache;
+    KnnSubscriptionManager subscriptions;
+    unordered_map<int, KnnDelta> pendingDeltas;  // per subscription, since its last poll
+    mutable mutex lock;
+    atomic<size_t> routeSearches;    // exact road searches while ranking
+    atomic<size_t> routeRejections;  // candidates skipped on their lower bound
+
+    static const size_t ROUTE_LISTED = 5;
+
+    void buildRoadNetwork(const point& pickup, const vector<point>& nearest, GridGraph& roadNetwork);
+    string computeRoute(const point& pickup, const vector<point>& nearest, bool expand);
+    static void writePath(ostringstream& out, const RunLengthPath& path, bool expand);
+    static void writePoints(ostringstream& out, const string& key, const vector<point>& points);
+    void recordDeltas(const vector<KnnDelta>& deltas);
+
+public:
+    TaxiEngine(const string& indexKind, const string& stateFile = "taxi_state.txt");
+
+    void load();
+    void save();
+
+    // Paths come back as turn points; expand lists every cell instead and
+    // bypasses the cache, which only holds the compact form.
+    string route(const point& pickup, int k = 5, bool expand = false);
+    string book(const point& pickup, const point& taxi, bool ride);
+    string dispatch(const vector<point>& pickups);
+
+    // A poll returns the taxis that entered and left the answer since the
+    // previous one, then the whole answer. Unknown ids return false.
+    string subscribe(const point& pickup, int k = 5);
+    bool pollSubscription(int id, string& response);
+    bool unsubscribe(int id);
+
+    int size() const;
+    RouteCacheMetrics cacheMetrics() const;
+    string metricsJson() const;
+};
+
+#endif
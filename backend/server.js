@@ -47,12 +47,14 @@ const server = http.createServer((req, res) => {
                 const data = JSON.parse(body);
                 const pickupX = parseInt(data.pickup.x);
                 const pickupY = parseInt(data.pickup.y);
+                // Paths come back as turn points unless the client asks for every cell
+                const expand = data.expand === true ? ' expand' : '';
 
                 console.log(`\nReceived request for nearest taxis to point (${pickupX}, ${pickupY})`);
-                console.log(`Calling C++ backend: ${CPP_EXECUTABLE} ${pickupX} ${pickupY}`);
+                console.log(`Calling C++ backend: ${CPP_EXECUTABLE} ${pickupX} ${pickupY}${expand}`);
 
                 // Call C++ executable with pickup coordinates
-                exec(`"${CPP_EXECUTABLE}" ${pickupX} ${pickupY}`, (error, stdout, stderr) => {
+                exec(`"${CPP_EXECUTABLE}" ${pickupX} ${pickupY}${expand}`, (error, stdout, stderr) => {
                     if (error) {
                         console.error('Error executing C++ backend:', error);
                         res.writeHead(500, { 'Content-Type': 'application/json' });
@@ -177,10 +179,10 @@ const server = http.createServer((req, res) => {
                 const taxiY = parseInt(data.taxi.y);
 
                 console.log(`\n[START RIDE] Moving taxi from (${taxiX}, ${taxiY}) to dropoff (${dropoffX}, ${dropoffY})`);
-                console.log(`Calling C++ backend: ${CPP_EXECUTABLE} ${dropoffX} ${dropoffY} ${taxiX} ${taxiY}`);
+                console.log(`Calling C++ backend: ${CPP_EXECUTABLE} ${dropoffX} ${dropoffY} ${taxiX} ${taxiY} ride`);
 
-                // Call C++ executable with ride command
-                exec(`"${CPP_EXECUTABLE}" ${dropoffX} ${dropoffY} ${taxiX} ${taxiY}`, (error, stdout, stderr) => {
+                // Call C++ executable with ride command (frees the taxi at the dropoff)
+                exec(`"${CPP_EXECUTABLE}" ${dropoffX} ${dropoffY} ${taxiX} ${taxiY} ride`, (error, stdout, stderr) => {
                     if (error) {
                         console.error('Error executing C++ backend:', error);
                         res.writeHead(500, { 'Content-Type': 'application/json' });
@@ -226,6 +228,58 @@ const server = http.createServer((req, res) => {
         return;
     }
 
+    // API endpoint for batch dispatch (assigns a window of pickups at once)
+    if (req.url === '/api/dispatch' && req.method === 'POST') {
+        let body = '';
+
+        req.on('data', chunk => {
+            body += chunk.toString();
+        });
+
+        req.on('end', () => {
+            try {
+                const data = JSON.parse(body);
+                const coords = data.pickups.map(p => `${parseInt(p.x)} ${parseInt(p.y)}`).join(' ');
+
+                console.log(`\n[DISPATCH] Assigning ${data.pickups.length} pickups`);
+                console.log(`Calling C++ backend: ${CPP_EXECUTABLE} dispatch ${coords}`);
+
+                exec(`"${CPP_EXECUTABLE}" dispatch ${coords}`, (error, stdout, stderr) => {
+                    if (error) {
+                        console.error('Error executing C++ backend:', error);
+                        res.writeHead(500, { 'Content-Type': 'application/json' });
+                        res.end(JSON.stringify({
+                            error: 'Failed to execute C++ backend',
+                            details: error.message
+                        }));
+                        return;
+                    }
+
+                    try {
+                        const result = JSON.parse(stdout.trim());
+                        console.log(`✓ Booked ${result.bookings.length}, unassigned ${result.unassigned.length}, total distance ${result.totalDistance}`);
+                        res.writeHead(200, { 'Content-Type': 'application/json' });
+                        res.end(JSON.stringify(result));
+                    } catch (parseError) {
+                        console.error('Error parsing C++ output:', parseError);
+                        console.error('C++ stdout:', stdout);
+                        console.error('C++ stderr:', stderr);
+                        res.writeHead(500, { 'Content-Type': 'application/json' });
+                        res.end(JSON.stringify({
+                            error: 'Failed to parse C++ output',
+                            details: parseError.message
+                        }));
+                    }
+                });
+            } catch (error) {
+                console.error('Error:', error.message);
+                res.writeHead(400, { 'Content-Type': 'application/json' });
+                res.end(JSON.stringify({ error: error.message }));
+            }
+        });
+        return;
+    }
+
     // API endpoint for moving a taxi dynamically (legacy)
     if (req.url === '/api/move-taxi' && req.method === 'POST') {
         let body = '';
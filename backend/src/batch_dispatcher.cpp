@@ -0,0 +1,248 @@
+#include "batch_dispatcher.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+// Cost of a rider/taxi pair that is not in the candidate graph. Larger than
+// any real total, so the solver prefers serving more riders first.
+static const long long MISSING_EDGE = 1000000000LL;
+
+BatchDispatcher::BatchDispatcher(SpatialIndex& index, const DispatchConfig& config, GridGraph* roads)
+    : index(index), config(config), roads(roads) {}
+
+int BatchDispatcher::manhattan(const point& a, const point& b) {
+    return abs(a.x - b.x) + abs(a.y - b.y);
+}
+
+int BatchDispatcher::findRoot(vector<int>& parent, int v) {
+    while (parent[v] != v) {
+        parent[v] = parent[parent[v]];
+        v = parent[v];
+    }
+    return v;
+}
+
+// O(n^2 m) Hungarian algorithm with potentials on the dense cost matrix of
+// one component, where n <= m is the smaller side.
+void BatchDispatcher::solveHungarian(const Component& component, vector<Edge>& matches) {
+    unordered_map<int, int> riderRow, taxiCol;
+    for (size_t i = 0; i < component.riders.size(); i++) riderRow[component.riders[i]] = i;
+    for (size_t j = 0; j < component.taxis.size(); j++) taxiCol[component.taxis[j]] = j;
+
+    bool transposed = component.riders.size() > component.taxis.size();
+    int n = transposed ? component.taxis.size() : component.riders.size();
+    int m = transposed ? component.riders.size() : component.taxis.size();
+
+    vector<long long> cost((size_t)n * m, MISSING_EDGE);
+    vector<const Edge*> chosen((size_t)n * m, nullptr);
+    for (const Edge& e : component.edges) {
+        int row = transposed ? taxiCol[e.taxi] : riderRow[e.rider];
+        int col = transposed ? riderRow[e.rider] : taxiCol[e.taxi];
+        cost[(size_t)row * m + col] = e.cost;
+        chosen[(size_t)row * m + col] = &e;
+    }
+
+    const long long INF = MISSING_EDGE * (n + 1);
+    vector<long long> u(n + 1, 0), v(m + 1, 0);
+    vector<int> p(m + 1, 0), way(m + 1, 0);
+
+    for (int i = 1; i <= n; i++) {
+        p[0] = i;
+        int j0 = 0;
+        vector<long long> minv(m + 1, INF);
+        vector<char> used(m + 1, false);
+        do {
+            used[j0] = true;
+            int i0 = p[j0], j1 = 0;
+            long long delta = INF;
+            for (int j = 1; j <= m; j++) {
+                if (used[j]) continue;
+                long long cur = cost[(size_t)(i0 - 1) * m + (j - 1)] - u[i0] - v[j];
+                if (cur < minv[j]) {
+                    minv[j] = cur;
+                    way[j] = j0;
+                }
+                if (minv[j] < delta) {
+                    delta = minv[j];
+                    j1 = j;
+                }
+            }
+            for (int j = 0; j <= m; j++) {
+                if (used[j]) {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                } else {
+                    minv[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (p[j0] != 0);
+
+        do {
+            int j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0);
+    }
+
+    for (int j = 1; j <= m; j++) {
+        if (p[j] == 0) continue;
+        const Edge* e = chosen[(size_t)(p[j] - 1) * m + (j - 1)];
+        if (e) matches.push_back(*e);
+    }
+}
+
+void BatchDispatcher::solveGreedy(const Component& component, vector<Edge>& matches) {
+    vector<Edge> edges(component.edges);
+    sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) { return a.cost < b.cost; });
+
+    unordered_set<int> riders, taxis;
+    for (const Edge& e : edges) {
+        if (riders.count(e.rider) || taxis.count(e.taxi)) continue;
+        riders.insert(e.rider);
+        taxis.insert(e.taxi);
+        matches.push_back(e);
+    }
+}
+
+DispatchResult BatchDispatcher::dispatch(const vector<PickupRequest>& window) {
+    auto start = chrono::steady_clock::now();
+    auto deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(
+                                chrono::duration<double, milli>(config.budgetMs));
+
+    DispatchResult result;
+    result.components = 0;
+    result.greedyComponents = 0;
+    result.totalDistance = 0;
+
+    int riderCount = window.size();
+    vector<point> taxis;
+    unordered_map<long long, int> taxiIds;
+    vector<Edge> edges;
+
+    for (int r = 0; r < riderCount; r++) {
+        const point& pickup = window[r].pickup;
+        vector<point> candidates = index.kNearestNeighbors(pickup, config.candidatesPerRider, window[r].filter);
+
+        if (roads) {
+            vector<pair<int, int>> locations;
+            for (const auto& c : candidates) locations.push_back({c.x, c.y});
+            roads->buildSparseGraph(locations, {pickup.x, pickup.y});
+        }
+
+        for (const auto& c : candidates) {
+            auto it = taxiIds.find(c.key());
+            if (it == taxiIds.end()) {
+                it = taxiIds.emplace(c.key(), (int)taxis.size()).first;
+                taxis.push_back(c);
+            }
+            edges.push_back({r, it->second, 0});
+        }
+    }
+
+    if (roads && config.landmarks > 0) roads->buildLandmarks(config.landmarks);
+
+    // Union-find over riders [0, riderCount) and taxis [riderCount, ...).
+    vector<int> parent(riderCount + taxis.size());
+    for (size_t i = 0; i < parent.size(); i++) parent[i] = i;
+    for (const Edge& e : edges) {
+        int a = findRoot(parent, e.rider);
+        int b = findRoot(parent, riderCount + e.taxi);
+        if (a != b) parent[a] = b;
+    }
+
+    unordered_map<int, int> componentOf;
+    vector<Component> components;
+    for (const Edge& e : edges) {
+        int root = findRoot(parent, e.rider);
+        auto it = componentOf.find(root);
+        if (it == componentOf.end()) {
+            it = componentOf.emplace(root, (int)components.size()).first;
+            components.push_back(Component());
+        }
+        components[it->second].edges.push_back(e);
+    }
+    for (int r = 0; r < riderCount; r++) {
+        auto it = componentOf.find(findRoot(parent, r));
+        if (it != componentOf.end()) components[it->second].riders.push_back(r);
+    }
+    for (size_t t = 0; t < taxis.size(); t++) {
+        components[componentOf[findRoot(parent, riderCount + t)]].taxis.push_back(t);
+    }
+
+    auto work = [](const Component& c) {
+        double n = min(c.riders.size(), c.taxis.size());
+        double m = max(c.riders.size(), c.taxis.size());
+        return n * n * m;
+    };
+    sort(components.begin(), components.end(),
+         [&work](const Component& a, const Component& b) { return work(a) > work(b); });
+
+    vector<vector<Edge>> matches(components.size());
+    vector<char> greedy(components.size(), false);
+    atomic<size_t> next(0);
+
+    auto solve = [&]() {
+        for (size_t c = next++; c < components.size(); c = next++) {
+            Component& component = components[c];
+            bool exact = chrono::steady_clock::now() < deadline && work(component) <= config.maxExactWork;
+
+            for (Edge& e : component.edges) {
+                const point& pickup = window[e.rider].pickup;
+                const point& taxi = taxis[e.taxi];
+                e.cost = exact && roads ? roads->dijkstra({taxi.x, taxi.y}, {pickup.x, pickup.y})
+                                        : manhattan(taxi, pickup);
+            }
+
+            if (exact) {
+                solveHungarian(component, matches[c]);
+            } else {
+                solveGreedy(component, matches[c]);
+                greedy[c] = true;
+            }
+        }
+    };
+
+    int workers = config.workers > 0 ? config.workers : (int)thread::hardware_concurrency();
+    workers = max(1, min(workers, (int)components.size()));
+    vector<thread> pool;
+    for (int i = 1; i < workers; i++) pool.emplace_back(solve);
+    solve();
+    for (auto& t : pool) t.join();
+
+    vector<const Edge*> assigned(riderCount, nullptr);
+    for (size_t c = 0; c < components.size(); c++) {
+        for (const Edge& e : matches[c]) assigned[e.rider] = &e;
+        if (greedy[c]) result.greedyComponents++;
+    }
+    result.components = components.size();
+
+    // Apply the round once it is decided: every assigned taxi leaves its
+    // cell before any arrives at a pickup, so a pickup on another assigned
+    // taxi's cell is not deleted by that taxi's own move.
+    vector<TaxiAttributes> attrs(riderCount);
+    for (int r = 0; r < riderCount; r++) {
+        if (!assigned[r]) {
+            result.unassigned.push_back(window[r].riderId);
+            continue;
+        }
+
+        const point& taxi = taxis[assigned[r]->taxi];
+        index.getAttributes(taxi, attrs[r]);
+        attrs[r].status = TaxiStatus::BOOKED;
+        index.deletePoint(taxi);
+
+        result.bookings.push_back({window[r].riderId, window[r].pickup, taxi, (int)assigned[r]->cost});
+        result.totalDistance += assigned[r]->cost;
+    }
+    for (int r = 0; r < riderCount; r++) {
+        if (assigned[r]) index.insert(window[r].pickup, attrs[r]);
+    }
+
+    result.elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return result;
+}
@@ -0,0 +1,509 @@
+#include "compact_kd_tree.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+template <typename Coord>
+CompactKDTree<Coord>::CompactKDTree(double compactionThreshold)
+    : root(NIL), live(0), dead(0),
+      compactionThreshold(min(max(compactionThreshold, 0.0), 1.0)) {}
+
+template <typename Coord>
+bool CompactKDTree<Coord>::fits(const point& p) {
+    return p.x >= numeric_limits<Coord>::min() && p.x <= numeric_limits<Coord>::max() &&
+           p.y >= numeric_limits<Coord>::min() && p.y <= numeric_limits<Coord>::max();
+}
+
+template <typename Coord>
+point CompactKDTree<Coord>::pointOf(const Node& n) {
+    return point(n.x, n.y);
+}
+
+template <typename Coord>
+TaxiAttributes CompactKDTree<Coord>::attrOf(const Node& n) {
+    return TaxiAttributes((TaxiStatus)n.status, n.vehicleClass, n.capacity);
+}
+
+template <typename Coord>
+void CompactKDTree<Coord>::setAttr(Node& n, const TaxiAttributes& attr) {
+    n.status = (uint8_t)attr.status;
+    n.vehicleClass = (uint8_t)min(max(attr.vehicleClass, 0), 255);
+    n.capacity = (uint8_t)min(max(attr.capacity, 0), 255);
+}
+
+template <typename Coord>
+uint32_t CompactKDTree<Coord>::newNode(const point& p, const TaxiAttributes& attr) {
+    Node n;
+    n.x = (Coord)p.x;
+    n.y = (Coord)p.y;
+    n.left = n.right = NIL;
+    setAttr(n, attr);
+    n.flags = 0;
+    nodes.push_back(n);
+
+    uint32_t i = nodes.size() - 1;
+    updateNode(i);
+    return i;
+}
+
+template <typename Coord>
+int CompactKDTree<Coord>::heightOf(uint32_t i) const {
+    return i == NIL ? 0 : nodes[i].height;
+}
+
+// Same aggregates as KDNode, with the available count reduced to a flag.
+template <typename Coord>
+void CompactKDTree<Coord>::updateNode(uint32_t i) {
+    Node& n = nodes[i];
+    n.flags &= DELETED;
+
+    if (n.flags & DELETED) {
+        n.minX = n.minY = numeric_limits<Coord>::max();
+        n.maxX = n.maxY = numeric_limits<Coord>::min();
+        n.classMask = 0;
+        n.maxCapacity = 0;
+    } else {
+        n.minX = n.maxX = n.x;
+        n.minY = n.maxY = n.y;
+        n.classMask = attrOf(n).classBit();
+        n.maxCapacity = n.capacity;
+        if (n.status == (uint8_t)TaxiStatus::AVAILABLE) n.flags |= SUBTREE_AVAILABLE;
+    }
+
+    int h = 0;
+    for (uint32_t c : {n.left, n.right}) {
+        if (c == NIL) continue;
+        const Node& child = nodes[c];
+        h = max(h, (int)child.height);
+        n.minX = min(n.minX, child.minX);
+        n.minY = min(n.minY, child.minY);
+        n.maxX = max(n.maxX, child.maxX);
+        n.maxY = max(n.maxY, child.maxY);
+        n.classMask |= child.classMask;
+        n.maxCapacity = max(n.maxCapacity, child.maxCapacity);
+        n.flags |= child.flags & SUBTREE_AVAILABLE;
+    }
+    n.height = (uint8_t)(h + 1);
+}
+
+template <typename Coord>
+bool CompactKDTree<Coord>::isBalanced(uint32_t i) const {
+    int leftHeight = heightOf(nodes[i].left);
+    int rightHeight = heightOf(nodes[i].right);
+    int diff = abs(leftHeight - rightHeight);
+
+    if (nodes[i].left == NIL || nodes[i].right == NIL) {
+        return diff <= 1;
+    }
+    return diff <= 1 || (leftHeight <= 2 * rightHeight && rightHeight <= 2 * leftHeight);
+}
+
+template <typename Coord>
+bool CompactKDTree<Coord>::compare(const point& a, const point& b, int depth) const {
+    if (depth % 2 == 0) return a.x != b.x ? a.x < b.x : a.y < b.y;
+    return a.y != b.y ? a.y < b.y : a.x < b.x;
+}
+
+template <typename Coord>
+uint32_t CompactKDTree<Coord>::find(const point& p) const {
+    uint32_t i = root;
+    for (int depth = 0; i != NIL; depth++) {
+        point q = pointOf(nodes[i]);
+        if (q == p) return i;
+        i = compare(p, q, depth) ? nodes[i].left : nodes[i].right;
+    }
+    return NIL;
+}
+
+template <typename Coord>
+void CompactKDTree<Coord>::collect(uint32_t i, vector<uint32_t>& out) const {
+    if (i == NIL) return;
+    collect(nodes[i].left, out);
+    out.push_back(i);
+    collect(nodes[i].right, out);
+}
+
+// Rebalances a subtree in place by relinking its slots around medians.
+template <typename Coord>
+uint32_t CompactKDTree<Coord>::relink(vector<uint32_t>& idx, int depth, int start, int end) {
+    if (start > end) return NIL;
+
+    sort(idx.begin() + start, idx.begin() + end + 1, [this, depth](uint32_t a, uint32_t b) {
+        return compare(pointOf(nodes[a]), pointOf(nodes[b]), depth);
+    });
+
+    int mid = (start + end) / 2;
+    uint32_t i = idx[mid];
+    nodes[i].left = relink(idx, depth + 1, start, mid - 1);
+    nodes[i].right = relink(idx, depth + 1, mid + 1, end);
+    updateNode(i);
+    return i;
+}
+
+// Emits nodes in preorder, so each subtree occupies a contiguous run.
+template <typename Coord>
+uint32_t CompactKDTree<Coord>::buildRange(vector<pair<point, TaxiAttributes>>& items,
+                                          int depth, int start, int end) {
+    if (start > end) return NIL;
+
+    int mid = (start + end) / 2;
+    nth_element(items.begin() + start, items.begin() + mid, items.begin() + end + 1,
+                [this, depth](const pair<point, TaxiAttributes>& a, const pair<point, TaxiAttributes>& b) {
+                    return compare(a.first, b.first, depth);
+                });
+
+    uint32_t i = newNode(items[mid].first, items[mid].second);
+    uint32_t left = buildRange(items, depth + 1, start, mid - 1);
+    uint32_t right = buildRange(items, depth + 1, mid + 1, end);
+    nodes[i].left = left;
+    nodes[i].right = right;
+    updateNode(i);
+    return i;
+}
+
+template <typename Coord>
+void CompactKDTree<Coord>::rebuildAll(vector<pair<point, TaxiAttributes>>& items) {
+    sort(items.begin(), items.end(), [this](const pair<point, TaxiAttributes>& a, const pair<point, TaxiAttributes>& b) {
+        return compare(a.first, b.first, 0);
+    });
+    items.erase(unique(items.begin(), items.end(),
+                       [](const pair<point, TaxiAttributes>& a, const pair<point, TaxiAttributes>& b) {
+                           return a.first == b.first;
+                       }),
+                items.end());
+
+    vector<Node>().swap(nodes);
+    nodes.reserve(items.size());
+    root = buildRange(items, 0, 0, (int)items.size() - 1);
+    live = items.size();
+    dead = 0;
+}
+
+template <typename Coord>
+void CompactKDTree<Coord>::compact() {
+    vector<pair<point, TaxiAttributes>> items;
+    items.reserve(live);
+    collectLive(root, items);
+    rebuildAll(items);
+}
+
+// Children are assigned through the index after each call because the
+// recursion may grow (and move) the node array.
+template <typename Coord>
+uint32_t CompactKDTree<Coord>::insertRecursive(uint32_t i, const point& p, const TaxiAttributes& attr,
+                                               bool replaceAttr, int depth) {
+    if (i == NIL) {
+        live++;
+        return newNode(p, attr);
+    }
+
+    point q = pointOf(nodes[i]);
+    if (q == p) {
+        if (nodes[i].flags & DELETED) {
+            nodes[i].flags &= ~DELETED;
+            setAttr(nodes[i], replaceAttr ? attr : TaxiAttributes());
+            live++;
+            dead--;
+        } else if (replaceAttr) {
+            setAttr(nodes[i], attr);
+        }
+        updateNode(i);
+        return i;
+    }
+
+    if (compare(p, q, depth)) {
+        uint32_t child = insertRecursive(nodes[i].left, p, attr, replaceAttr, depth + 1);
+        nodes[i].left = child;
+    } else {
+        uint32_t child = insertRecursive(nodes[i].right, p, attr, replaceAttr, depth + 1);
+        nodes[i].right = child;
+    }
+
+    updateNode(i);
+
+    if (!isBalanced(i)) {
+        vector<uint32_t> idx;
+        collect(i, idx);
+        i = relink(idx, depth, 0, (int)idx.size() - 1);
+    }
+    return i;
+}
+
+template <typename Coord>
+bool CompactKDTree<Coord>::markDeleted(uint32_t i, const point& p, int depth) {
+    if (i == NIL) return false;
+
+    bool found;
+    point q = pointOf(nodes[i]);
+    if (q == p) {
+        if (nodes[i].flags & DELETED) return false;
+        nodes[i].flags |= DELETED;
+        found = true;
+    } else {
+        found = markDeleted(compare(p, q, depth) ? nodes[i].left : nodes[i].right, p, depth + 1);
+    }
+
+    if (found) updateNode(i);
+    return found;
+}
+
+template <typename Coord>
+bool CompactKDTree<Coord>::setAttributesRecursive(uint32_t i, const point& p, const TaxiAttributes& attr, int depth) {
+    if (i == NIL) return false;
+
+    bool found;
+    point q = pointOf(nodes[i]);
+    if (q == p) {
+        if (nodes[i].flags & DELETED) return false;
+        setAttr(nodes[i], attr);
+        found = true;
+    } else {
+        found = setAttributesRecursive(compare(p, q, depth) ? nodes[i].left : nodes[i].right, p, attr, depth + 1);
+    }
+
+    if (found) updateNode(i);
+    return found;
+}
+
+template <typename Coord>
+bool CompactKDTree<Coord>::mayMatch(const Node& n, const TaxiFilter& filter) const {
+    if (filter.availableOnly && !(n.flags & SUBTREE_AVAILABLE)) return false;
+    if (filter.vehicleClass >= 0 && !(n.classMask & (1u << (filter.vehicleClass & 31)))) return false;
+    return n.maxCapacity >= filter.minCapacity;
+}
+
+template <typename Coord>
+double CompactKDTree<Coord>::boxDistanceSquared(const Node& n, const point& query) const {
+    double dx = 0, dy = 0;
+    if (query.x < n.minX) dx = (double)n.minX - query.x;
+    else if (query.x > n.maxX) dx = (double)query.x - n.maxX;
+    if (query.y < n.minY) dy = (double)n.minY - query.y;
+    else if (query.y > n.maxY) dy = (double)query.y - n.maxY;
+    return dx * dx + dy * dy;
+}
+
+template <typename Coord>
+void CompactKDTree<Coord>::knnHelper(uint32_t i, const point& query, priority_queue<pair<double, uint32_t>>& pq,
+                                     int k, const TaxiFilter& filter, KnnSearch& search) const {
+    if (i == NIL) return;
+    const Node& n = nodes[i];
+    if (!mayMatch(n, filter)) return;
+    if ((int)pq.size() == k) {
+        double box = boxDistanceSquared(n, query);
+        if (box >= pq.top().first) return;
+        if (box * search.scale >= pq.top().first) {
+            search.approximate = true;
+            return;
+        }
+    }
+    if (search.budget > 0 && search.visited >= search.budget) {
+        search.approximate = true;
+        return;
+    }
+    search.visited++;
+
+    if (!(n.flags & DELETED) && filter.matches(attrOf(n))) {
+        double dist = pointOf(n).distanceSquared(query);
+        if ((int)pq.size() < k) {
+            pq.push({dist, i});
+        } else if (dist < pq.top().first) {
+            pq.pop();
+            pq.push({dist, i});
+        }
+    }
+
+    uint32_t nearChild = n.left;
+    uint32_t farChild = n.right;
+    double nearDist = nearChild != NIL ? boxDistanceSquared(nodes[nearChild], query) : HUGE_VAL;
+    double farDist = farChild != NIL ? boxDistanceSquared(nodes[farChild], query) : HUGE_VAL;
+    if (farDist < nearDist) {
+        swap(nearChild, farChild);
+    }
+
+    knnHelper(nearChild, query, pq, k, filter, search);
+    knnHelper(farChild, query, pq, k, filter, search);
+}
+
+template <typename Coord>
+void CompactKDTree<Coord>::rangeHelper(uint32_t i, const point& low, const point& high, vector<point>& result) const {
+    if (i == NIL) return;
+    const Node& n = nodes[i];
+    if (n.maxX < low.x || n.minX > high.x || n.maxY < low.y || n.minY > high.y) return;
+
+    if (n.minX >= low.x && n.maxX <= high.x && n.minY >= low.y && n.maxY <= high.y) {
+        appendPoints(i, result);
+        return;
+    }
+
+    if (!(n.flags & DELETED) && n.x >= low.x && n.x <= high.x && n.y >= low.y && n.y <= high.y) {
+        result.push_back(pointOf(n));
+    }
+
+    rangeHelper(n.left, low, high, result);
+    rangeHelper(n.right, low, high, result);
+}
+
+template <typename Coord>
+void CompactKDTree<Coord>::appendPoints(uint32_t i, vector<point>& points) const {
+    if (i == NIL) return;
+    if (!(nodes[i].flags & DELETED)) points.push_back(pointOf(nodes[i]));
+    appendPoints(nodes[i].left, points);
+    appendPoints(nodes[i].right, points);
+}
+
+template <typename Coord>
+void CompactKDTree<Coord>::collectLive(uint32_t i, vector<pair<point, TaxiAttributes>>& taxis) const {
+    if (i == NIL) return;
+    if (!(nodes[i].flags & DELETED)) taxis.push_back({pointOf(nodes[i]), attrOf(nodes[i])});
+    collectLive(nodes[i].left, taxis);
+    collectLive(nodes[i].right, taxis);
+}
+
+template <typename Coord>
+void CompactKDTree<Coord>::buildFromVector(const vector<point>& points) {
+    buildFromVector(points, vector<TaxiAttributes>());
+}
+
+template <typename Coord>
+void CompactKDTree<Coord>::buildFromVector(const vector<point>& points, const vector<TaxiAttributes>& attrs) {
+    vector<pair<point, TaxiAttributes>> items;
+    items.reserve(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        if (fits(points[i])) items.push_back({points[i], attrs.empty() ? TaxiAttributes() : attrs[i]});
+    }
+    rebuildAll(items);
+}
+
+template <typename Coord>
+void CompactKDTree<Coord>::insert(const point& p) {
+    if (!fits(p)) return;
+    root = insertRecursive(root, p, TaxiAttributes(), false, 0);
+}
+
+template <typename Coord>
+void CompactKDTree<Coord>::insert(const point& p, const TaxiAttributes& attr) {
+    if (!fits(p)) return;
+    root = insertRecursive(root, p, attr, true, 0);
+}
+
+template <typename Coord>
+bool CompactKDTree<Coord>::deletePoint(const point& p) {
+    if (!fits(p) || !markDeleted(root, p, 0)) return false;
+
+    live--;
+    dead++;
+    if (dead > compactionThreshold * (live + dead)) {
+        compact();
+    }
+    return true;
+}
+
+template <typename Coord>
+bool CompactKDTree<Coord>::search(const point& p) {
+    if (!fits(p)) return false;
+    uint32_t i = find(p);
+    return i != NIL && !(nodes[i].flags & DELETED);
+}
+
+template <typename Coord>
+vector<point> CompactKDTree<Coord>::kNearestNeighbors(const point& query, int k) {
+    return kNearestNeighbors(query, k, TaxiFilter::any());
+}
+
+template <typename Coord>
+vector<point> CompactKDTree<Coord>::kNearestNeighbors(const point& query, int k, const TaxiFilter& filter) {
+    return kNearestNeighbors(query, k, filter, KnnOptions()).points;
+}
+
+template <typename Coord>
+KnnResult CompactKDTree<Coord>::kNearestNeighbors(const point& query, int k, const TaxiFilter& filter,
+                                                  const KnnOptions& options) {
+    KnnResult result;
+    if (root == NIL || k <= 0) return result;
+
+    double stretch = 1.0 + max(options.epsilon, 0.0);
+    KnnSearch search = {stretch * stretch, max(options.maxNodes, 0), 0, false};
+    priority_queue<pair<double, uint32_t>> pq;
+    knnHelper(root, query, pq, k, filter, search);
+
+    while (!pq.empty()) {
+        result.points.push_back(pointOf(nodes[pq.top().second]));
+        pq.pop();
+    }
+
+    reverse(result.points.begin(), result.points.end());
+    result.approximate = search.approximate;
+    result.nodesVisited = search.visited;
+    return result;
+}
+
+template <typename Coord>
+bool CompactKDTree<Coord>::setAttributes(const point& p, const TaxiAttributes& attr) {
+    return fits(p) && setAttributesRecursive(root, p, attr, 0);
+}
+
+template <typename Coord>
+bool CompactKDTree<Coord>::getAttributes(const point& p, TaxiAttributes& attr) {
+    if (!fits(p)) return false;
+    uint32_t i = find(p);
+    if (i == NIL || (nodes[i].flags & DELETED)) return false;
+    attr = attrOf(nodes[i]);
+    return true;
+}
+
+template <typename Coord>
+vector<point> CompactKDTree<Coord>::rangeSearch(const point& low, const point& high) {
+    vector<point> result;
+    rangeHelper(root, low, high, result);
+    return result;
+}
+
+template <typename Coord>
+int CompactKDTree<Coord>::getHeight() {
+    return heightOf(root);
+}
+
+template <typename Coord>
+int CompactKDTree<Coord>::size() {
+    return live;
+}
+
+template <typename Coord>
+void CompactKDTree<Coord>::getAllPoints(vector<point>& points) {
+    appendPoints(root, points);
+}
+
+template <typename Coord>
+void CompactKDTree<Coord>::getAllTaxis(vector<pair<point, TaxiAttributes>>& taxis) {
+    collectLive(root, taxis);
+}
+
+template <typename Coord>
+string CompactKDTree<Coord>::name() const {
+    return "compact";
+}
+
+template <typename Coord>
+int CompactKDTree<Coord>::tombstoneCount() const {
+    return dead;
+}
+
+template <typename Coord>
+size_t CompactKDTree<Coord>::memoryBytes() const {
+    return nodes.capacity() * sizeof(Node);
+}
+
+template <typename Coord>
+size_t CompactKDTree<Coord>::nodeBytes() {
+    return sizeof(Node);
+}
+
+template class CompactKDTree<int16_t>;
+template class CompactKDTree<int32_t>;
+
+unique_ptr<SpatialIndex> makeCompactKDTree(int minCoord, int maxCoord) {
+    if (minCoord >= numeric_limits<int16_t>::min() && maxCoord <= numeric_limits<int16_t>::max()) {
+        return unique_ptr<SpatialIndex>(new CompactKDTree<int16_t>());
+    }
+    return unique_ptr<SpatialIndex>(new CompactKDTree<int32_t>());
+}
@@ -1,4 +1,44 @@
 #include "dynamic_kd_tree.h"
+#include <thread>
+
+// Below these sizes a bulk build stays on the calling thread.
+static const int PARALLEL_BUILD_CUTOFF = 1 << 15;
+static const int PARALLEL_SORT_CUTOFF = 1 << 16;
+
+// Sorts power-of-two chunks on their own threads, then merges neighbouring
+// runs pairwise, each round of merges in parallel.
+template <typename Compare>
+static void parallelSort(vector<int>& keys, Compare less, int threads) {
+    int n = keys.size();
+    if (threads <= 1 || n < PARALLEL_SORT_CUTOFF) {
+        sort(keys.begin(), keys.end(), less);
+        return;
+    }
+
+    int chunks = 1;
+    while (chunks * 2 <= threads) chunks *= 2;
+    vector<int> bounds(chunks + 1);
+    for (int i = 0; i <= chunks; i++) bounds[i] = (int)((long long)n * i / chunks);
+
+    vector<thread> workers;
+    for (int i = 0; i < chunks; i++) {
+        workers.emplace_back([&keys, &bounds, less, i]() {
+            sort(keys.begin() + bounds[i], keys.begin() + bounds[i + 1], less);
+        });
+    }
+    for (auto& t : workers) t.join();
+
+    for (int width = 1; width < chunks; width *= 2) {
+        workers.clear();
+        for (int i = 0; i + width < chunks; i += 2 * width) {
+            int lo = bounds[i], mid = bounds[i + width], hi = bounds[min(i + 2 * width, chunks)];
+            workers.emplace_back([&keys, less, lo, mid, hi]() {
+                inplace_merge(keys.begin() + lo, keys.begin() + mid, keys.begin() + hi, less);
+            });
+        }
+        for (auto& t : workers) t.join();
+    }
+}
 
 DynamicKDTree::NodeDist::NodeDist(KDNode* n, double d) : node(n), dist(d) {}
 
@@ -17,6 +57,25 @@ void DynamicKDTree::updateHeight(KDNode* node) {
     node->height = 1 + max(getHeight(node->left), getHeight(node->right));
 }
 
+void DynamicKDTree::updateNode(KDNode* node) {
+    if (!node) return;
+    updateHeight(node);
+
+    node->resetAggregates();
+    for (KDNode* child : {node->left, node->right}) {
+        if (!child) continue;
+        node->subtreeSize += child->subtreeSize;
+        node->deadCount += child->deadCount;
+        node->availableCount += child->availableCount;
+        node->classMask |= child->classMask;
+        node->maxCapacity = max(node->maxCapacity, child->maxCapacity);
+        node->minX = min(node->minX, child->minX);
+        node->minY = min(node->minY, child->minY);
+        node->maxX = max(node->maxX, child->maxX);
+        node->maxY = max(node->maxY, child->maxY);
+    }
+}
+
 int DynamicKDTree::getBalanceFactor(KDNode* node) {
     if (!node) return 0;
     return getHeight(node->left) - getHeight(node->right);
@@ -58,138 +117,142 @@ KDNode* DynamicKDTree::search(KDNode* node, const point& p, int depth) {
     return search(goLeft ? node->left : node->right, p, depth + 1);
 }
 
+// Relinks the existing nodes of the subtree instead of reallocating them, so
+// each taxi keeps its attributes across the rebuild. Tombstones are dropped.
 KDNode* DynamicKDTree::rebuild(KDNode* node, int depth) {
     if (!node) return nullptr;
 
-    vector<point> points;
-    collectpoints(node, points);
+    vector<KDNode*> nodes;
+    collectNodes(node, nodes);
+    stats.rebuilds++;
+    stats.rebuiltNodes += nodes.size();
 
-    deleteTree(node);
+    size_t live = 0;
+    for (KDNode* n : nodes) {
+        if (n->deleted) delete n;
+        else nodes[live++] = n;
+    }
+    nodes.resize(live);
 
-    return buildBalanced(points, depth, 0, points.size() - 1);
+    return buildBalanced(nodes, depth, 0, (int)nodes.size() - 1);
 }
 
-void DynamicKDTree::collectpoints(KDNode* node, vector<point>& points) {
+void DynamicKDTree::collectNodes(KDNode* node, vector<KDNode*>& nodes) {
     if (!node) return;
-    collectpoints(node->left, points);
-    points.push_back(node->p);
-    collectpoints(node->right, points);
+    collectNodes(node->left, nodes);
+    nodes.push_back(node);
+    collectNodes(node->right, nodes);
 }
 
-KDNode* DynamicKDTree::buildBalanced(vector<point>& points, int depth, int start, int end) {
+KDNode* DynamicKDTree::buildBalanced(vector<KDNode*>& nodes, int depth, int start, int end) {
     if (start > end) return nullptr;
 
-    sort(points.begin() + start, points.begin() + end + 1,
-         [depth, this](const point& a, const point& b) {
-             return compare(a, b, depth);
+    sort(nodes.begin() + start, nodes.begin() + end + 1,
+         [depth, this](const KDNode* a, const KDNode* b) {
+             return compare(a->p, b->p, depth);
          });
 
     int mid = (start + end) / 2;
-    KDNode* node = new KDNode(points[mid]);
+    KDNode* node = nodes[mid];
 
-    node->left = buildBalanced(points, depth + 1, start, mid - 1);
-    node->right = buildBalanced(points, depth + 1, mid + 1, end);
+    node->left = buildBalanced(nodes, depth + 1, start, mid - 1);
+    node->right = buildBalanced(nodes, depth + 1, mid + 1, end);
 
-    updateHeight(node);
+    updateNode(node);
     return node;
 }
 
+// Duplicates order by descending index, so the copy unique keeps is the
+// last one given, as if the points had been inserted in order, and the
+// result does not depend on how the sort was split across threads.
 bool DynamicKDTree::comp_xy_points(int a, int b, const vector<point>& data) {
-    if (data[a].x == data[b].x) {
-        return data[a].y < data[b].y;
-    }
-    return data[a].x < data[b].x;
+    if (data[a].x != data[b].x) return data[a].x < data[b].x;
+    if (data[a].y != data[b].y) return data[a].y < data[b].y;
+    return a > b;
 }
 
 bool DynamicKDTree::comp_yx_points(int a, int b, const vector<point>& data) {
-    if (data[a].y == data[b].y) {
-        return data[a].x < data[b].x;
-    }
-    return data[a].y < data[b].y;
+    if (data[a].y != data[b].y) return data[a].y < data[b].y;
+    if (data[a].x != data[b].x) return data[a].x < data[b].x;
+    return a > b;
 }
 
-KDNode* DynamicKDTree::buildKDTreeFromVector(vector<int>& xy_superKey_temp, vector<int>& yx_superKey_temp,
-                                             bool div_x, const vector<point>& data) {
-    int len = xy_superKey_temp.size();
-    if (len == 0) return nullptr;
+// Presorted build that keeps both superkeys in place. The halves of the
+// splitting key are already contiguous; the other key is split stably around
+// the median through the scratch span of the same range. Every subtree owns
+// disjoint ranges of all three arrays, so large subtrees build in parallel.
+KDNode* DynamicKDTree::buildKDTreeFromVector(int* xy_superKey, int* yx_superKey, int* scratch, int len,
+                                             bool div_x, const vector<point>& data,
+                                             const vector<TaxiAttributes>& attrs, int spawnDepth) {
+    if (len <= 0) return nullptr;
 
     int mid = len / 2;
-    int idx;
-    KDNode* node;
-
-    if (div_x) {
-        idx = xy_superKey_temp[mid];
-        node = new KDNode(data[idx].x, data[idx].y);
-
-        vector<int> left_xy_superKey(xy_superKey_temp.begin(), xy_superKey_temp.begin() + mid);
-        vector<int> left_yx_superKey;
-        left_yx_superKey.reserve(mid);
-        for (int i = 0; i < len; i++) {
-            if (comp_xy_points(yx_superKey_temp[i], idx, data) && yx_superKey_temp[i] != idx) {
-                left_yx_superKey.push_back(yx_superKey_temp[i]);
-            }
-        }
-        node->left = buildKDTreeFromVector(left_xy_superKey, left_yx_superKey, !div_x, data);
-
-        vector<int> right_xy_superKey(xy_superKey_temp.begin() + mid + 1, xy_superKey_temp.end());
-        vector<int> right_yx_superKey;
-        right_yx_superKey.reserve(mid);
-        for (int i = 0; i < len; i++) {
-            if (!comp_xy_points(yx_superKey_temp[i], idx, data) && yx_superKey_temp[i] != idx) {
-                right_yx_superKey.push_back(yx_superKey_temp[i]);
-            }
-        }
-        node->right = buildKDTreeFromVector(right_xy_superKey, right_yx_superKey, !div_x, data);
-
+    int* primary = div_x ? xy_superKey : yx_superKey;
+    int* secondary = div_x ? yx_superKey : xy_superKey;
+    int idx = primary[mid];
+    KDNode* node = new KDNode(data[idx], attrs.empty() ? TaxiAttributes() : attrs[idx]);
+
+    copy(secondary, secondary + len, scratch);
+    int left = 0, right = mid + 1;
+    for (int i = 0; i < len; i++) {
+        int key = scratch[i];
+        if (key == idx) continue;
+        bool goesLeft = div_x ? comp_xy_points(key, idx, data) : comp_yx_points(key, idx, data);
+        secondary[goesLeft ? left++ : right++] = key;
+    }
+    secondary[mid] = idx;
+
+    auto buildLeft = [&]() {
+        node->left = buildKDTreeFromVector(xy_superKey, yx_superKey, scratch, mid,
+                                           !div_x, data, attrs, spawnDepth - 1);
+    };
+    auto buildRight = [&]() {
+        node->right = buildKDTreeFromVector(xy_superKey + mid + 1, yx_superKey + mid + 1, scratch + mid + 1,
+                                            len - mid - 1, !div_x, data, attrs, spawnDepth - 1);
+    };
+
+    if (spawnDepth > 0 && len >= PARALLEL_BUILD_CUTOFF) {
+        thread worker(buildLeft);
+        buildRight();
+        worker.join();
     } else {
-        idx = yx_superKey_temp[mid];
-        node = new KDNode(data[idx].x, data[idx].y);
-
-        vector<int> left_yx_superKey(yx_superKey_temp.begin(), yx_superKey_temp.begin() + mid);
-        vector<int> left_xy_superKey;
-        left_xy_superKey.reserve(mid);
-        for (int i = 0; i < len; i++) {
-            if (comp_yx_points(xy_superKey_temp[i], idx, data) && xy_superKey_temp[i] != idx) {
-                left_xy_superKey.push_back(xy_superKey_temp[i]);
-            }
-        }
-        node->left = buildKDTreeFromVector(left_xy_superKey, left_yx_superKey, !div_x, data);
-
-        vector<int> right_yx_superKey(yx_superKey_temp.begin() + mid + 1, yx_superKey_temp.end());
-        vector<int> right_xy_superKey;
-        right_xy_superKey.reserve(mid);
-        for (int i = 0; i < len; i++) {
-            if (!comp_yx_points(xy_superKey_temp[i], idx, data) && xy_superKey_temp[i] != idx) {
-                right_xy_superKey.push_back(xy_superKey_temp[i]);
-            }
-        }
-        node->right = buildKDTreeFromVector(right_xy_superKey, right_yx_superKey, !div_x, data);
+        buildLeft();
+        buildRight();
     }
 
-    updateHeight(node);
+    updateNode(node);
     return node;
 }
 
-KDNode* DynamicKDTree::insertRecursive(KDNode* node, const point& p, int depth, bool& needRebalance) {
+KDNode* DynamicKDTree::insertRecursive(KDNode* node, const point& p, const TaxiAttributes& attr,
+                                       bool replaceAttr, int depth, bool& needRebalance) {
     if (!node) {
         needRebalance = false;
-        return new KDNode(p);
+        return new KDNode(p, attr);
     }
 
     if (node->p == p) {
         needRebalance = false;
+        if (node->deleted) {
+            node->deleted = false;
+            node->attr = replaceAttr ? attr : TaxiAttributes();
+            updateNode(node);
+        } else if (replaceAttr) {
+            node->attr = attr;
+            updateNode(node);
+        }
         return node;
     }
 
     bool goLeft = compare(p, node->p, depth);
 
     if (goLeft) {
-        node->left = insertRecursive(node->left, p, depth + 1, needRebalance);
+        node->left = insertRecursive(node->left, p, attr, replaceAttr, depth + 1, needRebalance);
     } else {
-        node->right = insertRecursive(node->right, p, depth + 1, needRebalance);
+        node->right = insertRecursive(node->right, p, attr, replaceAttr, depth + 1, needRebalance);
     }
 
-    updateHeight(node);
+    updateNode(node);
 
     if (!isBalanced(node)) {
         node = rebuild(node, depth);
@@ -252,7 +315,8 @@ KDNode* DynamicKDTree::deleteRecursive(KDNode* node, const point& p, int depth,
     }
 
     if (node->p == p) {
-        found = true;
+        bool wasLive = !node->deleted;
+        found = wasLive;
 
         if (!node->left && !node->right) {
             delete node;
@@ -271,14 +335,23 @@ KDNode* DynamicKDTree::deleteRecursive(KDNode* node, const point& p, int depth,
         if (getHeight(node->right) >= getHeight(node->left)) {
             replacement = findMin(node->right, dim, depth + 1);
             point tempP = replacement->p;
+            TaxiAttributes tempAttr = replacement->attr;
+            bool tempDeleted = replacement->deleted;
             node->right = deleteRecursive(node->right, tempP, depth + 1, found);
             node->p = tempP;
+            node->attr = tempAttr;
+            node->deleted = tempDeleted;
         } else {
             replacement = findMax(node->left, dim, depth + 1);
             point tempP = replacement->p;
+            TaxiAttributes tempAttr = replacement->attr;
+            bool tempDeleted = replacement->deleted;
             node->left = deleteRecursive(node->left, tempP, depth + 1, found);
             node->p = tempP;
+            node->attr = tempAttr;
+            node->deleted = tempDeleted;
         }
+        found = wasLive;
 
     } else {
         bool goLeft = compare(p, node->p, depth);
@@ -291,7 +364,44 @@ KDNode* DynamicKDTree::deleteRecursive(KDNode* node, const point& p, int depth,
 
     if (!node) return nullptr;
 
-    updateHeight(node);
+    updateNode(node);
+
+    if (!isBalanced(node)) {
+        node = rebuild(node, depth);
+    }
+
+    return node;
+}
+
+// Marks the node dead and refreshes the aggregates on the way back up. A
+// dead leaf routes nothing, so it is unlinked on the spot instead of
+// waiting for a compaction.
+KDNode* DynamicKDTree::tombstoneRecursive(KDNode* node, const point& p, int depth, bool& found) {
+    if (!node) {
+        found = false;
+        return nullptr;
+    }
+
+    if (node->p == p) {
+        found = !node->deleted;
+        node->deleted = true;
+    } else {
+        bool goLeft = compare(p, node->p, depth);
+        if (goLeft) {
+            node->left = tombstoneRecursive(node->left, p, depth + 1, found);
+        } else {
+            node->right = tombstoneRecursive(node->right, p, depth + 1, found);
+        }
+    }
+
+    if (!found) return node;
+
+    if (node->deleted && !node->left && !node->right) {
+        delete node;
+        return nullptr;
+    }
+
+    updateNode(node);
 
     if (!isBalanced(node)) {
         node = rebuild(node, depth);
@@ -300,6 +410,81 @@ KDNode* DynamicKDTree::deleteRecursive(KDNode* node, const point& p, int depth,
     return node;
 }
 
+// Walks from the root towards p and compacts the highest subtree whose dead
+// share passes the threshold. Small subtrees are never compacted on their
+// own: a single tombstone puts a handful of nodes over any threshold, and
+// rebuilding them on every delete costs more than routing past them.
+KDNode* DynamicKDTree::compactPath(KDNode* node, const point& p, int depth) {
+    if (!node || node->deadCount == 0 || node->subtreeSize < MIN_COMPACTION_SIZE) return node;
+
+    if (node->deadCount > compactionThreshold * node->subtreeSize) {
+        return compact(node, depth);
+    }
+
+    if (node->p == p) return node;
+    if (compare(p, node->p, depth)) {
+        node->left = compactPath(node->left, p, depth + 1);
+    } else {
+        node->right = compactPath(node->right, p, depth + 1);
+    }
+    updateNode(node);
+    return node;
+}
+
+KDNode* DynamicKDTree::compact(KDNode* node, int depth) {
+    vector<KDNode*> nodes;
+    collectNodes(node, nodes);
+
+    vector<point> points;
+    vector<TaxiAttributes> attrs;
+    points.reserve(nodes.size());
+    attrs.reserve(nodes.size());
+    for (KDNode* n : nodes) {
+        if (!n->deleted) {
+            points.push_back(n->p);
+            attrs.push_back(n->attr);
+        }
+        delete n;
+    }
+
+    stats.compactions++;
+    stats.compactedNodes += nodes.size();
+    return buildPresorted(points, attrs, depth % 2 == 0);
+}
+
+KDNode* DynamicKDTree::buildPresorted(const vector<point>& points, const vector<TaxiAttributes>& attrs,
+                                      bool div_x) {
+    if (points.empty()) return nullptr;
+
+    int n = points.size();
+    int threads = threadsForBuild();
+    vector<int> xy_superKey(n);
+
+    for (int i = 0; i < n; i++) {
+        xy_superKey[i] = i;
+    }
+
+    parallelSort(xy_superKey, [&points, this](int a, int b) { return comp_xy_points(a, b, points); }, threads);
+    xy_superKey.erase(unique(xy_superKey.begin(), xy_superKey.end(),
+                             [&points](int a, int b) { return points[a] == points[b]; }),
+                      xy_superKey.end());
+
+    vector<int> yx_superKey(xy_superKey);
+    parallelSort(yx_superKey, [&points, this](int a, int b) { return comp_yx_points(a, b, points); }, threads);
+
+    vector<int> scratch(xy_superKey.size());
+    int spawnDepth = 0;
+    while ((1 << spawnDepth) < threads) spawnDepth++;
+
+    return buildKDTreeFromVector(xy_superKey.data(), yx_superKey.data(), scratch.data(),
+                                 (int)xy_superKey.size(), div_x, points, attrs, spawnDepth);
+}
+
+int DynamicKDTree::threadsForBuild() const {
+    if (buildThreads > 0) return buildThreads;
+    return max(1, (int)thread::hardware_concurrency());
+}
+
 void DynamicKDTree::deleteTree(KDNode* node) {
     if (!node) return;
     deleteTree(node->left);
@@ -307,37 +492,160 @@ void DynamicKDTree::deleteTree(KDNode* node) {
     delete node;
 }
 
-void DynamicKDTree::knnHelper(KDNode* node, const point& query, int depth,
-                               priority_queue<NodeDist>& pq, int k) {
-    if (!node) return;
+bool DynamicKDTree::setAttributesRecursive(KDNode* node, const point& p, const TaxiAttributes& attr, int depth) {
+    if (!node) return false;
 
-    double dist = sqrt(pow(node->p.x - query.x, 2) + pow(node->p.y - query.y, 2));
+    bool found;
+    if (node->p == p) {
+        if (node->deleted) return false;
+        node->attr = attr;
+        found = true;
+    } else {
+        bool goLeft = compare(p, node->p, depth);
+        found = setAttributesRecursive(goLeft ? node->left : node->right, p, attr, depth + 1);
+    }
 
-    if ((int)pq.size() < k) {
-        pq.push(NodeDist(node, dist));
-    } else if (dist < pq.top().dist) {
-        pq.pop();
-        pq.push(NodeDist(node, dist));
+    if (found) updateNode(node);
+    return found;
+}
+
+// Conservative test on the subtree aggregates: false means no taxi below
+// node can pass the filter, so the whole subtree can be skipped.
+bool DynamicKDTree::mayMatch(KDNode* node, const TaxiFilter& filter) {
+    if (filter.availableOnly && node->availableCount == 0) return false;
+    if (filter.vehicleClass >= 0 && !(node->classMask & (1u << (filter.vehicleClass & 31)))) return false;
+    return node->maxCapacity >= filter.minCapacity;
+}
+
+double DynamicKDTree::boxDistanceSquared(KDNode* node, const point& query) {
+    double dx = 0, dy = 0;
+    if (query.x < node->minX) dx = (double)node->minX - query.x;
+    else if (query.x > node->maxX) dx = (double)query.x - node->maxX;
+    if (query.y < node->minY) dy = (double)node->minY - query.y;
+    else if (query.y > node->maxY) dy = (double)query.y - node->maxY;
+    return dx * dx + dy * dy;
+}
+
+// Distances in the queue are squared. A subtree is skipped once its bounding
+// box is no closer than the current k-th candidate, and the child whose box
+// is nearer to the query is searched first.
+// Subtrees the exact bound cannot rule out may still be skipped by the
+// (1 + epsilon) bound or an exhausted budget; either marks the answer
+// approximate.
+void DynamicKDTree::knnHelper(KDNode* node, const point& query, priority_queue<NodeDist>& pq, int k,
+                              const TaxiFilter& filter, KnnSearch& search) {
+    if (!node || !mayMatch(node, filter)) return;
+    if ((int)pq.size() == k) {
+        double box = boxDistanceSquared(node, query);
+        if (box >= pq.top().dist) return;
+        if (box * search.scale >= pq.top().dist) {
+            search.approximate = true;
+            return;
+        }
+    }
+    if (search.budget > 0 && search.visited >= search.budget) {
+        search.approximate = true;
+        return;
+    }
+    search.visited++;
+
+    if (!node->deleted && filter.matches(node->attr)) {
+        double dist = node->p.distanceSquared(query);
+        if ((int)pq.size() < k) {
+            pq.push(NodeDist(node, dist));
+        } else if (dist < pq.top().dist) {
+            pq.pop();
+            pq.push(NodeDist(node, dist));
+        }
     }
 
-    int diff = (depth % 2 == 0) ? (query.x - node->p.x) : (query.y - node->p.y);
+    KDNode* nearChild = node->left;
+    KDNode* farChild = node->right;
+    double nearDist = nearChild ? boxDistanceSquared(nearChild, query) : HUGE_VAL;
+    double farDist = farChild ? boxDistanceSquared(farChild, query) : HUGE_VAL;
+    if (farDist < nearDist) {
+        swap(nearChild, farChild);
+    }
 
-    KDNode* nearChild = (diff < 0) ? node->left : node->right;
-    KDNode* farChild = (diff < 0) ? node->right : node->left;
+    knnHelper(nearChild, query, pq, k, filter, search);
+    knnHelper(farChild, query, pq, k, filter, search);
+}
+
+int DynamicKDTree::liveCount(KDNode* node, bool availableOnly) {
+    return availableOnly ? node->availableCount : node->subtreeSize - node->deadCount;
+}
 
-    knnHelper(nearChild, query, depth + 1, pq, k);
+// Subtrees inside the rectangle contribute their stored count; only those
+// straddling its edge are descended into.
+int DynamicKDTree::rangeCountHelper(KDNode* node, const point& low, const point& high, bool availableOnly) {
+    if (!node || liveCount(node, availableOnly) == 0) return 0;
+    if (node->maxX < low.x || node->minX > high.x || node->maxY < low.y || node->minY > high.y) return 0;
 
-    if ((int)pq.size() < k || diff * diff < pq.top().dist) {
-        knnHelper(farChild, query, depth + 1, pq, k);
+    if (node->minX >= low.x && node->maxX <= high.x && node->minY >= low.y && node->maxY <= high.y) {
+        return liveCount(node, availableOnly);
+    }
+
+    int count = 0;
+    if (!node->deleted && (!availableOnly || node->attr.available()) &&
+        node->p.x >= low.x && node->p.x <= high.x && node->p.y >= low.y && node->p.y <= high.y) {
+        count++;
     }
+    return count + rangeCountHelper(node->left, low, high, availableOnly) +
+           rangeCountHelper(node->right, low, high, availableOnly);
 }
 
+static long long zoneIndex(long long offset, int width) {
+    return offset >= 0 ? offset / width : -((-offset + width - 1) / width);
+}
+
+// One pass for the whole grid: a subtree whose box falls in a single zone
+// adds its count there, one that spans several is split further.
+void DynamicKDTree::zoneCountHelper(KDNode* node, const ZoneGrid& grid, bool availableOnly, vector<int>& counts) {
+    if (!node || liveCount(node, availableOnly) == 0) return;
+
+    long long colLo = zoneIndex((long long)node->minX - grid.origin.x, grid.cellWidth);
+    long long colHi = zoneIndex((long long)node->maxX - grid.origin.x, grid.cellWidth);
+    long long rowLo = zoneIndex((long long)node->minY - grid.origin.y, grid.cellHeight);
+    long long rowHi = zoneIndex((long long)node->maxY - grid.origin.y, grid.cellHeight);
+    if (colHi < 0 || rowHi < 0 || colLo >= grid.cols || rowLo >= grid.rows) return;
+
+    if (colLo == colHi && rowLo == rowHi) {
+        counts[rowLo * grid.cols + colLo] += liveCount(node, availableOnly);
+        return;
+    }
+
+    if (!node->deleted && (!availableOnly || node->attr.available())) {
+        long long col = zoneIndex((long long)node->p.x - grid.origin.x, grid.cellWidth);
+        long long row = zoneIndex((long long)node->p.y - grid.origin.y, grid.cellHeight);
+        if (col >= 0 && row >= 0 && col < grid.cols && row < grid.rows) counts[row * grid.cols + col]++;
+    }
+    zoneCountHelper(node->left, grid, availableOnly, counts);
+    zoneCountHelper(node->right, grid, availableOnly, counts);
+}
+
+void DynamicKDTree::rangeHelper(KDNode* node, const point& low, const point& high, vector<point>& result) {
+    if (!node) return;
+    if (node->maxX < low.x || node->minX > high.x || node->maxY < low.y || node->minY > high.y) return;
+
+    if (node->minX >= low.x && node->maxX <= high.x && node->minY >= low.y && node->maxY <= high.y) {
+        getAllPointsHelper(node, result);
+        return;
+    }
+
+    if (!node->deleted && node->p.x >= low.x && node->p.x <= high.x &&
+        node->p.y >= low.y && node->p.y <= high.y) {
+        result.push_back(node->p);
+    }
+
+    rangeHelper(node->left, low, high, result);
+    rangeHelper(node->right, low, high, result);
+}
 
 DynamicKDTree::DynamicKDTree()
-    : root(nullptr) {}
+    : root(nullptr), mode(DeleteMode::EAGER), compactionThreshold(0.25), stats(), buildThreads(0) {}
 
 DynamicKDTree::DynamicKDTree(const vector<point>& initialPoints)
-    : root(nullptr) {
+    : root(nullptr), mode(DeleteMode::EAGER), compactionThreshold(0.25), stats(), buildThreads(0) {
     buildFromVector(initialPoints);
 }
 
@@ -346,74 +654,117 @@ DynamicKDTree::~DynamicKDTree() {
 }
 
 void DynamicKDTree::buildFromVector(const vector<point>& points) {
+    buildFromVector(points, vector<TaxiAttributes>());
+}
+
+void DynamicKDTree::buildFromVector(const vector<point>& points, const vector<TaxiAttributes>& attrs) {
     if (root) {
         deleteTree(root);
         root = nullptr;
     }
 
-    if (points.empty()) return;
-
-    int n = points.size();
-    vector<int> xy_superKey(n);
-    vector<int> yx_superKey(n);
-
-    for (int i = 0; i < n; i++) {
-        xy_superKey[i] = i;
-        yx_superKey[i] = i;
-    }
-
-    sort(xy_superKey.begin(), xy_superKey.end(),
-         [&points, this](int a, int b) { return comp_xy_points(a, b, points); });
-    sort(yx_superKey.begin(), yx_superKey.end(),
-         [&points, this](int a, int b) { return comp_yx_points(a, b, points); });
-
-    root = buildKDTreeFromVector(xy_superKey, yx_superKey, true, points);
+    root = buildPresorted(points, attrs, true);
 }
 
 void DynamicKDTree::insert(const point& p) {
     bool needRebalance = false;
-    root = insertRecursive(root, p, 0, needRebalance);
+    root = insertRecursive(root, p, TaxiAttributes(), false, 0, needRebalance);
+}
+
+void DynamicKDTree::insert(const point& p, const TaxiAttributes& attr) {
+    bool needRebalance = false;
+    root = insertRecursive(root, p, attr, true, 0, needRebalance);
 }
 
 bool DynamicKDTree::deletePoint(const point& p) {
     bool found = false;
-    root = deleteRecursive(root, p, 0, found);
+    if (mode == DeleteMode::TOMBSTONE) {
+        root = tombstoneRecursive(root, p, 0, found);
+        if (found) root = compactPath(root, p, 0);
+    } else {
+        root = deleteRecursive(root, p, 0, found);
+    }
     return found;
 }
 
 bool DynamicKDTree::search(const point& p) {
-    return search(root, p, 0) != nullptr;
+    KDNode* node = search(root, p, 0);
+    return node && !node->deleted;
 }
 
 vector<point> DynamicKDTree::kNearestNeighbors(const point& query, int k) {
-    vector<point> result;
+    return kNearestNeighbors(query, k, TaxiFilter::any());
+}
+
+vector<point> DynamicKDTree::kNearestNeighbors(const point& query, int k, const TaxiFilter& filter) {
+    return kNearestNeighbors(query, k, filter, KnnOptions()).points;
+}
+
+KnnResult DynamicKDTree::kNearestNeighbors(const point& query, int k, const TaxiFilter& filter,
+                                           const KnnOptions& options) {
+    KnnResult result;
     if (!root || k <= 0) return result;
 
+    double stretch = 1.0 + max(options.epsilon, 0.0);
+    KnnSearch search = {stretch * stretch, max(options.maxNodes, 0), 0, false};
     priority_queue<NodeDist> pq;
-    knnHelper(root, query, 0, pq, k);
+    knnHelper(root, query, pq, k, filter, search);
 
     while (!pq.empty()) {
-        result.push_back(pq.top().node->p);
+        result.points.push_back(pq.top().node->p);
         pq.pop();
     }
 
-    reverse(result.begin(), result.end());
+    reverse(result.points.begin(), result.points.end());
+    result.approximate = search.approximate;
+    result.nodesVisited = search.visited;
     return result;
 }
 
+bool DynamicKDTree::setAttributes(const point& p, const TaxiAttributes& attr) {
+    return setAttributesRecursive(root, p, attr, 0);
+}
+
+bool DynamicKDTree::getAttributes(const point& p, TaxiAttributes& attr) {
+    KDNode* node = search(root, p, 0);
+    if (!node || node->deleted) return false;
+    attr = node->attr;
+    return true;
+}
+
+NearestTaxiIterator DynamicKDTree::nearest(const point& query, const TaxiFilter& filter) {
+    return NearestTaxiIterator(this, query, filter);
+}
+
+vector<point> DynamicKDTree::rangeSearch(const point& low, const point& high) {
+    vector<point> result;
+    rangeHelper(root, low, high, result);
+    return result;
+}
+
+int DynamicKDTree::rangeCount(const point& low, const point& high, bool availableOnly) {
+    return rangeCountHelper(root, low, high, availableOnly);
+}
+
+vector<int> DynamicKDTree::zoneCounts(const ZoneGrid& grid, bool availableOnly) {
+    vector<int> counts;
+    if (!grid.valid()) return counts;
+    counts.assign((size_t)grid.cols * grid.rows, 0);
+    zoneCountHelper(root, grid, availableOnly, counts);
+    return counts;
+}
+
 int DynamicKDTree::getHeight() {
     return getHeight(root);
 }
 
 int DynamicKDTree::size() {
-    int count = 0;
-    countNodes(root, count);
-    return count;
+    return root ? root->subtreeSize - root->deadCount : 0;
 }
 
 void DynamicKDTree::countNodes(KDNode* node, int& count) {
     if (!node) return;
-    count++;
+    if (!node->deleted) count++;
     countNodes(node->left, count);
     countNodes(node->right, count);
 }
@@ -426,7 +777,7 @@ void DynamicKDTree::inorder() {
 void DynamicKDTree::inorderHelper(KDNode* node) {
     if (!node) return;
     inorderHelper(node->left);
-    cout << "(" << node->p.x << "," << node->p.y << ") ";
+    if (!node->deleted) cout << "(" << node->p.x << "," << node->p.y << ") ";
     inorderHelper(node->right);
 }
 
@@ -436,11 +787,65 @@ void DynamicKDTree::getAllPoints(vector<point>& points) {
 
 void DynamicKDTree::getAllPointsHelper(KDNode* node, vector<point>& points) {
     if (!node) return;
-    points.push_back(node->p);
+    if (!node->deleted) points.push_back(node->p);
     getAllPointsHelper(node->left, points);
     getAllPointsHelper(node->right, points);
 }
 
+void DynamicKDTree::getAllTaxis(vector<pair<point, TaxiAttributes>>& taxis) {
+    getAllTaxisHelper(root, taxis);
+}
+
+void DynamicKDTree::getAllTaxisHelper(KDNode* node, vector<pair<point, TaxiAttributes>>& taxis) {
+    if (!node) return;
+    if (!node->deleted) taxis.push_back({node->p, node->attr});
+    getAllTaxisHelper(node->left, taxis);
+    getAllTaxisHelper(node->right, taxis);
+}
+
+int DynamicKDTree::availableCount() {
+    return root ? root->availableCount : 0;
+}
+
+// Switching back to EAGER compacts the whole tree so no tombstone outlives
+// the mode that created it.
+void DynamicKDTree::setDeleteMode(DeleteMode mode, double compactionThreshold) {
+    this->mode = mode;
+    this->compactionThreshold = min(max(compactionThreshold, 0.0), 1.0);
+    if (mode == DeleteMode::EAGER && root && root->deadCount > 0) {
+        root = compact(root, 0);
+    }
+}
+
+DeleteMode DynamicKDTree::deleteMode() const {
+    return mode;
+}
+
+int DynamicKDTree::tombstoneCount() {
+    return root ? root->deadCount : 0;
+}
+
+size_t DynamicKDTree::compactionCount() const {
+    return stats.compactions;
+}
+
+RebuildStats DynamicKDTree::rebuildStats() const {
+    return stats;
+}
+
+void DynamicKDTree::resetRebuildStats() {
+    stats = RebuildStats();
+}
+
+// 0 uses every hardware thread; 1 keeps bulk builds serial.
+void DynamicKDTree::setBuildThreads(int threads) {
+    buildThreads = max(0, threads);
+}
+
+string DynamicKDTree::name() const {
+    return "kdtree";
+}
+
 void DynamicKDTree::nearestNeighbor(KDNode* node,
                                     const point& query,
                                     int depth,
@@ -451,7 +856,7 @@ void DynamicKDTree::nearestNeighbor(KDNode* node,
     double dist = sqrt(pow(node->p.x - query.x, 2) +
                        pow(node->p.y - query.y, 2));
 
-    if (!best || dist < bestDist) {
+    if (!node->deleted && (!best || dist < bestDist)) {
         best = node;
         bestDist = dist;
     }
@@ -465,8 +870,66 @@ void DynamicKDTree::nearestNeighbor(KDNode* node,
 
     nearestNeighbor(nearChild, query, depth + 1, best, bestDist);
 
-    if (diff * diff < bestDist) {
+    if (diff * diff < bestDist * bestDist) {
         nearestNeighbor(farChild, query, depth + 1, best, bestDist);
     }
 }
 
+// On equal distance a taxi comes out before a box, so it is returned
+// without expanding subtrees that cannot beat it.
+bool NearestTaxiIterator::Entry::operator>(const Entry& other) const {
+    if (dist != other.dist) return dist > other.dist;
+    return !isPoint && other.isPoint;
+}
+
+NearestTaxiIterator::NearestTaxiIterator(DynamicKDTree* tree, const point& query, const TaxiFilter& filter)
+    : tree(tree), query(query), filter(filter), visited(0) {
+    vector<Entry> storage;
+    storage.reserve(64);
+    frontier = priority_queue<Entry, vector<Entry>, greater<Entry>>(greater<Entry>(), move(storage));
+    pushSubtree(tree->root);
+}
+
+void NearestTaxiIterator::pushSubtree(KDNode* node) {
+    if (!node || !tree->mayMatch(node, filter)) return;
+    frontier.push({tree->boxDistanceSquared(node, query), node, false});
+}
+
+bool NearestTaxiIterator::next(point& taxi) {
+    double distanceSquared;
+    return next(taxi, distanceSquared);
+}
+
+bool NearestTaxiIterator::next(point& taxi, double& distanceSquared) {
+    while (!frontier.empty()) {
+        Entry top = frontier.top();
+        frontier.pop();
+
+        if (top.isPoint) {
+            taxi = top.node->p;
+            distanceSquared = top.dist;
+            return true;
+        }
+
+        KDNode* node = top.node;
+        visited++;
+        pushSubtree(node->left);
+        pushSubtree(node->right);
+        if (node->deleted || !filter.matches(node->attr)) continue;
+
+        // A taxi no farther than anything left on the frontier is next in
+        // order and skips the round trip through the heap.
+        double dist = node->p.distanceSquared(query);
+        if (frontier.empty() || dist <= frontier.top().dist) {
+            taxi = node->p;
+            distanceSquared = dist;
+            return true;
+        }
+        frontier.push({dist, node, true});
+    }
+    return false;
+}
+
+int NearestTaxiIterator::nodesVisited() const {
+    return visited;
+}
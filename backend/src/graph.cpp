@@ -1,4 +1,5 @@
 #include "graph.h" 
+#include "landmarks.h"
 #include <iostream>   
 #include <queue>      
 #include <set>        
@@ -12,6 +13,7 @@ bool GridGraph::isValid(int x, int y) const {
 }
 
 void GridGraph::addEdge(const pair<int, int>& node1, const pair<int, int>& node2) {
+    landmarks.reset();
     adjacencyList[node1].push_back(node2);
     adjacencyList[node2].push_back(node1);
 }
@@ -79,10 +81,82 @@ vector<pair<pair<int,int>, pair<int,int>>> GridGraph::getAllEdges() const {
     return edges;
 }
 
-vector<pair<int, int>> GridGraph::dijkstraPath(pair<int, int> start, pair<int, int> end) {
-    vector<pair<int, int>> path;
+void RunLengthPath::step(int dx, int dy) {
+    if(!runs.empty() && runs.back().dx == dx && runs.back().dy == dy) {
+        runs.back().length++;
+    } else {
+        runs.push_back({(signed char)dx, (signed char)dy, 1});
+    }
+}
+
+int RunLengthPath::length() const {
+    int cells = 0;
+    for(const auto& run : runs) cells += run.length;
+    return cells;
+}
+
+pair<int, int> RunLengthPath::end() const {
+    pair<int, int> at = start;
+    for(const auto& run : runs) {
+        at.first += run.dx * run.length;
+        at.second += run.dy * run.length;
+    }
+    return at;
+}
+
+RunLengthPath RunLengthPath::reversed() const {
+    RunLengthPath back(end());
+    for(auto it = runs.rbegin(); it != runs.rend(); ++it) {
+        back.runs.push_back({(signed char)-it->dx, (signed char)-it->dy, it->length});
+    }
+    return back;
+}
+
+vector<pair<int, int>> RunLengthPath::turnPoints() const {
+    vector<pair<int, int>> points;
+    points.reserve(runs.size() + 1);
+    pair<int, int> at = start;
+    points.push_back(at);
+    for(const auto& run : runs) {
+        at.first += run.dx * run.length;
+        at.second += run.dy * run.length;
+        points.push_back(at);
+    }
+    return points;
+}
+
+vector<pair<int, int>> RunLengthPath::expand() const {
+    vector<pair<int, int>> cells;
+    cells.reserve(length() + 1);
+    pair<int, int> at = start;
+    cells.push_back(at);
+    for(const auto& run : runs) {
+        for(int i = 0; i < run.length; i++) {
+            at.first += run.dx;
+            at.second += run.dy;
+            cells.push_back(at);
+        }
+    }
+    return cells;
+}
+
+// Straight x-then-y walk, the answer when no road connects the two ends.
+RunLengthPath GridGraph::manhattanPath(pair<int, int> start, pair<int, int> end) {
+    RunLengthPath path(start);
+    int dx = end.first - start.first;
+    int dy = end.second - start.second;
+    if(dx != 0) path.runs.push_back({(signed char)(dx > 0 ? 1 : -1), 0, abs(dx)});
+    if(dy != 0) path.runs.push_back({0, (signed char)(dy > 0 ? 1 : -1), abs(dy)});
+    return path;
+}
+
+RunLengthPath GridGraph::dijkstraPath(pair<int, int> start, pair<int, int> end) const {
+    RunLengthPath path(start);
     if(start == end) {
-        path.push_back(start);
+        return path;
+    }
+    if(landmarks) {
+        if(landmarks->search(start, end, &path) < 0) path = manhattanPath(start, end);
         return path;
     }
 
@@ -101,14 +175,14 @@ vector<pair<int, int>> GridGraph::dijkstraPath(pair<int, int> start, pair<int, i
         pq.pop();
 
         if(currentNode == end) {
+            RunLengthPath back(end);
             pair<int, int> current = end;
             while(current != start) {
-                path.push_back(current);
-                current = previous[current];
+                pair<int, int> before = previous[current];
+                back.step(before.first - current.first, before.second - current.second);
+                current = before;
             }
-            path.push_back(start);
-            reverse(path.begin(), path.end());
-            return path;
+            return back.reversed();
         }
 
         if(distances.count(currentNode) && currentDist > distances[currentNode]) {
@@ -129,22 +203,16 @@ vector<pair<int, int>> GridGraph::dijkstraPath(pair<int, int> start, pair<int, i
         }
     }
 
-    int x = start.first, y = start.second;
-    path.push_back({x, y});
-    
-    while(x != end.first || y != end.second) {
-        if(x < end.first) x++;
-        else if(x > end.first) x--;
-        else if(y < end.second) y++;
-        else if(y > end.second) y--;
-        path.push_back({x, y});
-    }
-    
-    return path;
+    return manhattanPath(start, end);
 }
 
-int GridGraph::dijkstra(pair<int, int> start, pair<int, int> end) {
+int GridGraph::dijkstra(pair<int, int> start, pair<int, int> end) const {
     if(start == end) return 0;
+    if(landmarks) {
+        int distance = landmarks->search(start, end, nullptr);
+        if(distance >= 0) return distance;
+        return abs(end.first - start.first) + abs(end.second - start.second);
+    }
 
     unordered_map<pair<int, int>, int, PairHash> distances;
     priority_queue<pair<int, pair<int, int>>,
@@ -181,4 +249,30 @@ int GridGraph::dijkstra(pair<int, int> start, pair<int, int> end) {
     }
 
     return abs(end.first - start.first) + abs(end.second - start.second);
-}
\ No newline at end of file
+}
+
+void GridGraph::buildLandmarks(int count) {
+    shared_ptr<LandmarkTable> table = make_shared<LandmarkTable>();
+    table->build(*this, count);
+    landmarks = table;
+}
+
+bool GridGraph::saveLandmarks(const string& path) const {
+    return landmarks && landmarks->save(path);
+}
+
+bool GridGraph::loadLandmarks(const string& path) {
+    shared_ptr<LandmarkTable> table = make_shared<LandmarkTable>();
+    if(!table->load(path, *this)) return false;
+    landmarks = table;
+    return true;
+}
+
+bool GridGraph::hasLandmarks() const {
+    return landmarks != nullptr;
+}
+
+int GridGraph::lowerBound(pair<int, int> start, pair<int, int> end) const {
+    if(landmarks) return landmarks->lowerBound(start, end);
+    return abs(end.first - start.first) + abs(end.second - start.second);
+}
@@ -0,0 +1,205 @@
+#include "grid_index.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+UniformGridIndex::UniformGridIndex(int minCoord, int maxCoord, int cellSize)
+    : minCoord(minCoord), maxCoord(maxCoord), cellSize(max(1, cellSize)), count(0) {
+    int span = maxCoord - minCoord + 1;
+    cellsPerSide = max(1, (span + this->cellSize - 1) / this->cellSize);
+    cells.resize(cellsPerSide * cellsPerSide);
+}
+
+int UniformGridIndex::cellCoord(int v) const {
+    int c = (v - minCoord) / cellSize;
+    if (v < minCoord) c = 0;
+    return min(max(c, 0), cellsPerSide - 1);
+}
+
+int UniformGridIndex::cellIndex(const point& p) const {
+    return cellCoord(p.y) * cellsPerSide + cellCoord(p.x);
+}
+
+UniformGridIndex::Entry* UniformGridIndex::find(const point& p) {
+    for (auto& entry : cells[cellIndex(p)]) {
+        if (entry.p == p) return &entry;
+    }
+    return nullptr;
+}
+
+void UniformGridIndex::buildFromVector(const vector<point>& points) {
+    buildFromVector(points, vector<TaxiAttributes>());
+}
+
+void UniformGridIndex::buildFromVector(const vector<point>& points, const vector<TaxiAttributes>& attrs) {
+    for (auto& cell : cells) cell.clear();
+    count = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        if (find(points[i])) continue;
+        cells[cellIndex(points[i])].push_back({points[i], attrs.empty() ? TaxiAttributes() : attrs[i]});
+        count++;
+    }
+}
+
+void UniformGridIndex::insert(const point& p) {
+    if (find(p)) return;
+    cells[cellIndex(p)].push_back({p, TaxiAttributes()});
+    count++;
+}
+
+void UniformGridIndex::insert(const point& p, const TaxiAttributes& attr) {
+    Entry* entry = find(p);
+    if (entry) {
+        entry->attr = attr;
+        return;
+    }
+    cells[cellIndex(p)].push_back({p, attr});
+    count++;
+}
+
+bool UniformGridIndex::deletePoint(const point& p) {
+    vector<Entry>& cell = cells[cellIndex(p)];
+    for (auto& entry : cell) {
+        if (entry.p == p) {
+            entry = cell.back();
+            cell.pop_back();
+            count--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool UniformGridIndex::search(const point& p) {
+    return find(p) != nullptr;
+}
+
+bool UniformGridIndex::setAttributes(const point& p, const TaxiAttributes& attr) {
+    Entry* entry = find(p);
+    if (!entry) return false;
+    entry->attr = attr;
+    return true;
+}
+
+bool UniformGridIndex::getAttributes(const point& p, TaxiAttributes& attr) {
+    Entry* entry = find(p);
+    if (!entry) return false;
+    attr = entry->attr;
+    return true;
+}
+
+void UniformGridIndex::scanCell(int cx, int cy, const point& query, int k, const TaxiFilter& filter,
+                                priority_queue<pair<double, int>>& pq, vector<point>& candidates) {
+    for (const auto& entry : cells[cy * cellsPerSide + cx]) {
+        if (!filter.matches(entry.attr)) continue;
+        const point& p = entry.p;
+        double dist = p.distance(query);
+        if ((int)pq.size() < k) {
+            candidates.push_back(p);
+            pq.push({dist, (int)candidates.size() - 1});
+        } else if (dist < pq.top().first) {
+            candidates[pq.top().second] = p;
+            int slot = pq.top().second;
+            pq.pop();
+            pq.push({dist, slot});
+        }
+    }
+}
+
+vector<point> UniformGridIndex::kNearestNeighbors(const point& query, int k) {
+    return kNearestNeighbors(query, k, TaxiFilter::any());
+}
+
+vector<point> UniformGridIndex::kNearestNeighbors(const point& query, int k, const TaxiFilter& filter) {
+    vector<point> result;
+    if (count == 0 || k <= 0) return result;
+
+    int qcx = cellCoord(query.x);
+    int qcy = cellCoord(query.y);
+    priority_queue<pair<double, int>> pq;
+    vector<point> candidates;
+    candidates.reserve(k);
+
+    for (int r = 0;; r++) {
+        for (int cy = qcy - r; cy <= qcy + r; cy++) {
+            if (cy < 0 || cy >= cellsPerSide) continue;
+            bool edgeRow = (cy == qcy - r || cy == qcy + r);
+            for (int cx = qcx - r; cx <= qcx + r; cx += (edgeRow ? 1 : 2 * r)) {
+                if (cx >= 0 && cx < cellsPerSide) {
+                    scanCell(cx, cy, query, k, filter, pq, candidates);
+                }
+                if (r == 0) break;
+            }
+        }
+
+        // Lower bound on the distance to any point in a cell outside the
+        // (2r+1)^2 block scanned so far.
+        bool more = false;
+        double bound = numeric_limits<double>::max();
+        if (qcx - r > 0) {
+            more = true;
+            bound = min(bound, (double)query.x - (minCoord + (qcx - r) * cellSize - 1));
+        }
+        if (qcx + r < cellsPerSide - 1) {
+            more = true;
+            bound = min(bound, (double)(minCoord + (qcx + r + 1) * cellSize) - query.x);
+        }
+        if (qcy - r > 0) {
+            more = true;
+            bound = min(bound, (double)query.y - (minCoord + (qcy - r) * cellSize - 1));
+        }
+        if (qcy + r < cellsPerSide - 1) {
+            more = true;
+            bound = min(bound, (double)(minCoord + (qcy + r + 1) * cellSize) - query.y);
+        }
+
+        if (!more) break;
+        if ((int)pq.size() == k && pq.top().first <= bound) break;
+    }
+
+    while (!pq.empty()) {
+        result.push_back(candidates[pq.top().second]);
+        pq.pop();
+    }
+    reverse(result.begin(), result.end());
+    return result;
+}
+
+vector<point> UniformGridIndex::rangeSearch(const point& low, const point& high) {
+    vector<point> result;
+    for (int cy = cellCoord(low.y); cy <= cellCoord(high.y); cy++) {
+        for (int cx = cellCoord(low.x); cx <= cellCoord(high.x); cx++) {
+            for (const auto& entry : cells[cy * cellsPerSide + cx]) {
+                const point& p = entry.p;
+                if (p.x >= low.x && p.x <= high.x && p.y >= low.y && p.y <= high.y) {
+                    result.push_back(p);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+int UniformGridIndex::getHeight() {
+    return 1;
+}
+
+int UniformGridIndex::size() {
+    return count;
+}
+
+void UniformGridIndex::getAllPoints(vector<point>& points) {
+    for (const auto& cell : cells) {
+        for (const auto& entry : cell) points.push_back(entry.p);
+    }
+}
+
+void UniformGridIndex::getAllTaxis(vector<pair<point, TaxiAttributes>>& taxis) {
+    for (const auto& cell : cells) {
+        for (const auto& entry : cell) taxis.push_back({entry.p, entry.attr});
+    }
+}
+
+string UniformGridIndex::name() const {
+    return "grid";
+}
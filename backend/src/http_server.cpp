@@ -0,0 +1,581 @@
+#include "http_server.h"
+#include <iostream>
+#include <sstream>
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const int MAX_EVENTS = 64;
+
+// Minimal readers for the flat request bodies the frontend sends. Numbers
+// are truncated toward zero the way server.js's parseInt did.
+static bool readNumber(const string& object, const string& key, int& value) {
+    size_t k = object.find("\"" + key + "\"");
+    if (k == string::npos) return false;
+    size_t colon = object.find(':', k);
+    if (colon == string::npos) return false;
+
+    size_t start = object.find_first_not_of(" \t\r\n\"", colon + 1);
+    if (start == string::npos) return false;
+    const char* begin = object.c_str() + start;
+    char* end;
+    double v = strtod(begin, &end);
+    if (end == begin || !std::isfinite(v)) return false;
+    value = (int)trunc(v);
+    return true;
+}
+
+// True only for a literal true (or a non-zero number).
+static bool readFlag(const string& object, const string& key) {
+    size_t k = object.find("\"" + key + "\"");
+    if (k == string::npos) return false;
+    size_t colon = object.find(':', k);
+    if (colon == string::npos) return false;
+    size_t start = object.find_first_not_of(" \t\r\n", colon + 1);
+    if (start == string::npos) return false;
+    if (object.compare(start, 4, "true") == 0) return true;
+    int value;
+    return readNumber(object, key, value) && value != 0;
+}
+
+static bool readPoint(const string& body, const string& key, point& p) {
+    size_t k = body.find("\"" + key + "\"");
+    if (k == string::npos) return false;
+    size_t open = body.find('{', k);
+    size_t close = open == string::npos ? string::npos : body.find('}', open);
+    if (close == string::npos) return false;
+
+    string object = body.substr(open, close - open + 1);
+    return readNumber(object, "x", p.x) && readNumber(object, "y", p.y);
+}
+
+static bool readPoints(const string& body, const string& key, vector<point>& points) {
+    size_t k = body.find("\"" + key + "\"");
+    if (k == string::npos) return false;
+    size_t open = body.find('[', k);
+    size_t close = open == string::npos ? string::npos : body.find(']', open);
+    if (close == string::npos) return false;
+
+    for (size_t pos = open; ; ) {
+        size_t o = body.find('{', pos);
+        if (o == string::npos || o > close) break;
+        size_t c = body.find('}', o);
+        if (c == string::npos || c > close) return false;
+        string object = body.substr(o, c - o + 1);
+        point p(0, 0);
+        if (!readNumber(object, "x", p.x) || !readNumber(object, "y", p.y)) return false;
+        points.push_back(p);
+        pos = c + 1;
+    }
+    return true;
+}
+
+static string lower(string s) {
+    transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return tolower(c); });
+    return s;
+}
+
+HttpServer::HttpServer(TaxiEngine& engine, const HttpServerConfig& config)
+    : engine(engine), config(config), listenFd(-1), epollFd(-1), wakeFd(-1), running(false),
+      nextGeneration(1), requests(0), errors(0), accepted(0), active(0), keepAliveReuses(0) {}
+
+HttpServer::~HttpServer() {
+    stop();
+    for (auto& t : workers) t.join();
+    for (auto& entry : connections) close(entry.first);
+    if (listenFd >= 0) close(listenFd);
+    if (epollFd >= 0) close(epollFd);
+    if (wakeFd >= 0) close(wakeFd);
+}
+
+bool HttpServer::start() {
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        perror("socket");
+        return false;
+    }
+
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(config.port);
+    if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, SOMAXCONN) < 0) {
+        perror("bind/listen");
+        return false;
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0) {
+        perror("epoll/eventfd");
+        return false;
+    }
+
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = listenFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+    ev.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+
+    running = true;
+    for (int i = 0; i < max(1, config.workers); i++) {
+        workers.emplace_back(&HttpServer::workerLoop, this);
+    }
+    return true;
+}
+
+void HttpServer::run() {
+    epoll_event events[MAX_EVENTS];
+
+    while (running) {
+        int n = epoll_wait(epollFd, events, MAX_EVENTS, deferred.empty() ? -1 : 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                acceptAll();
+                continue;
+            }
+            if (fd == wakeFd) {
+                uint64_t count;
+                while (read(wakeFd, &count, sizeof(count)) > 0) {}
+                drainCompletions();
+                continue;
+            }
+
+            auto it = connections.find(fd);
+            if (it == connections.end()) continue;
+            Connection* conn = it->second;
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(conn);
+                continue;
+            }
+            service(conn);
+        }
+
+        vector<pair<int, unsigned>> again;
+        again.swap(deferred);
+        for (const auto& d : again) {
+            auto it = connections.find(d.first);
+            if (it != connections.end() && it->second->generation == d.second) service(it->second);
+        }
+    }
+}
+
+void HttpServer::stop() {
+    if (!running.exchange(false)) return;
+    {
+        lock_guard<mutex> guard(jobLock);
+    }
+    jobReady.notify_all();
+    if (wakeFd >= 0) {
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {}
+    }
+}
+
+HttpServer::Connection* HttpServer::acquireConnection(int fd) {
+    Connection* conn;
+    if (freeConnections.empty()) {
+        connectionPool.emplace_back(new Connection());
+        conn = connectionPool.back().get();
+        conn->readBuffer.resize(config.readBufferSize);
+        conn->writeBuffer.reserve(config.writeBufferSize);
+    } else {
+        conn = freeConnections.back();
+        freeConnections.pop_back();
+    }
+
+    conn->fd = fd;
+    conn->generation = nextGeneration++;
+    conn->readLength = 0;
+    conn->writeBuffer.clear();
+    conn->writeOffset = 0;
+    conn->busy = false;
+    conn->closeAfterWrite = false;
+    conn->served = 0;
+    connections[fd] = conn;
+    active++;
+    return conn;
+}
+
+void HttpServer::closeConnection(Connection* conn) {
+    close(conn->fd);
+    connections.erase(conn->fd);
+    freeConnections.push_back(conn);
+    active--;
+}
+
+void HttpServer::acceptAll() {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (connections.size() >= config.maxConnections) {
+            close(fd);
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        accepted++;
+
+        acquireConnection(fd);
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+// Edge-triggered: drain the socket until EAGAIN. While a request is in
+// flight the buffer may fill up; the rest stays in the kernel and is read
+// once the response has been written. Returns false if the peer is gone.
+bool HttpServer::readAll(Connection* conn) {
+    while (conn->readLength < conn->readBuffer.size()) {
+        ssize_t n = recv(conn->fd, conn->readBuffer.data() + conn->readLength,
+                         conn->readBuffer.size() - conn->readLength, 0);
+        if (n > 0) {
+            conn->readLength += n;
+        } else if (n == 0) {
+            closeConnection(conn);
+            return false;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            closeConnection(conn);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Takes at most one complete request off the read buffer. It is either
+// answered inline into the write buffer or queued for a worker; both leave
+// the connection busy until the response is out.
+void HttpServer::parseRequest(Connection* conn) {
+    if (conn->busy) return;
+
+    const char* data = conn->readBuffer.data();
+    string head(data, conn->readLength);
+    size_t headerEnd = head.find("\r\n\r\n");
+    if (headerEnd == string::npos) {
+        if (conn->readLength < conn->readBuffer.size()) return;
+        errors++;
+        respond(conn, httpResponse(413, "{\"error\":\"Request too large\"}", false), false);
+        return;
+    }
+
+    istringstream lines(head.substr(0, headerEnd));
+    string requestLine;
+    getline(lines, requestLine);
+    istringstream parts(requestLine);
+    Job job;
+    string version;
+    parts >> job.method >> job.path >> version;
+    job.path = job.path.substr(0, job.path.find('?'));
+    job.keepAlive = version != "HTTP/1.0";
+
+    size_t contentLength = 0;
+    bool badLength = false;
+    string line;
+    while (getline(lines, line)) {
+        size_t colon = line.find(':');
+        if (colon == string::npos) continue;
+        string name = lower(line.substr(0, colon));
+        string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        value.erase(value.find_last_not_of(" \t\r") + 1);
+        if (name == "content-length") {
+            // Digits only; anything longer than the buffer is simply too
+            // large, and is never added to an offset.
+            if (value.empty() || value.find_first_not_of("0123456789") != string::npos) {
+                badLength = true;
+            } else {
+                size_t digits = value.find_first_not_of('0');
+                contentLength = digits == string::npos ? 0
+                              : value.size() - digits > 10 ? conn->readBuffer.size() + 1
+                              : min((size_t)stoull(value.substr(digits)), conn->readBuffer.size() + 1);
+            }
+        } else if (name == "connection") {
+            string v = lower(value);
+            if (v == "close") job.keepAlive = false;
+            else if (v == "keep-alive") job.keepAlive = true;
+        }
+    }
+
+    if (badLength) {
+        errors++;
+        respond(conn, httpResponse(400, "{\"error\":\"Invalid Content-Length\"}", false), false);
+        return;
+    }
+    if (contentLength > conn->readBuffer.size() - (headerEnd + 4)) {
+        errors++;
+        respond(conn, httpResponse(413, "{\"error\":\"Request too large\"}", false), false);
+        return;
+    }
+    size_t total = headerEnd + 4 + contentLength;
+    if (conn->readLength < total) return;
+
+    job.body.assign(data + headerEnd + 4, contentLength);
+    memmove(conn->readBuffer.data(), data + total, conn->readLength - total);
+    conn->readLength -= total;
+
+    requests++;
+    if (conn->served++ > 0) keepAliveReuses++;
+    conn->busy = true;
+
+    if (job.method == "OPTIONS") {
+        respond(conn, httpResponse(200, "", job.keepAlive), job.keepAlive);
+        return;
+    }
+
+    job.fd = conn->fd;
+    job.generation = conn->generation;
+    {
+        lock_guard<mutex> guard(jobLock);
+        jobs.push_back(job);
+    }
+    jobReady.notify_one();
+}
+
+void HttpServer::respond(Connection* conn, const string& response, bool keepAlive) {
+    conn->busy = true;
+    conn->writeBuffer += response;
+    conn->closeAfterWrite = !keepAlive;
+}
+
+// Writes as much as the socket takes; EPOLLOUT resumes the rest. Returns
+// false once the connection is closed.
+bool HttpServer::flush(Connection* conn) {
+    if (conn->writeBuffer.empty()) return true;
+
+    while (conn->writeOffset < conn->writeBuffer.size()) {
+        ssize_t n = send(conn->fd, conn->writeBuffer.data() + conn->writeOffset,
+                         conn->writeBuffer.size() - conn->writeOffset, MSG_NOSIGNAL);
+        if (n > 0) {
+            conn->writeOffset += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        } else {
+            closeConnection(conn);
+            return false;
+        }
+    }
+
+    conn->writeBuffer.clear();
+    conn->writeOffset = 0;
+    conn->busy = false;
+    if (conn->closeAfterWrite) {
+        closeConnection(conn);
+        return false;
+    }
+    return true;
+}
+
+// Write, read, parse, repeat, until the connection waits on the socket or a
+// worker. Pipelined requests answered inline (OPTIONS, errors) would keep
+// this going indefinitely, so after maxRequestsPerWakeup rounds the
+// connection goes on the deferred list and the event loop comes back to it
+// after serving everyone else.
+void HttpServer::service(Connection* conn) {
+    for (size_t round = 0; round < config.maxRequestsPerWakeup; round++) {
+        if (!flush(conn)) return;
+        if (conn->busy) return;
+        if (!readAll(conn)) return;
+        parseRequest(conn);
+        if (!conn->busy) return;
+    }
+    deferred.push_back({conn->fd, conn->generation});
+}
+
+void HttpServer::drainCompletions() {
+    vector<Completion> ready;
+    {
+        lock_guard<mutex> guard(completionLock);
+        ready.swap(completions);
+    }
+
+    for (const auto& done : ready) {
+        auto it = connections.find(done.fd);
+        if (it == connections.end() || it->second->generation != done.generation) continue;
+        respond(it->second, done.response, done.keepAlive);
+        service(it->second);
+    }
+}
+
+void HttpServer::workerLoop() {
+    while (true) {
+        Job job;
+        {
+            unique_lock<mutex> guard(jobLock);
+            jobReady.wait(guard, [this]() { return !jobs.empty() || !running; });
+            if (jobs.empty()) return;
+            job = jobs.front();
+            jobs.pop_front();
+        }
+
+        int status = 200;
+        string body = handle(job, status);
+        if (status >= 400) errors++;
+
+        {
+            lock_guard<mutex> guard(completionLock);
+            completions.push_back({job.fd, job.generation, httpResponse(status, body, job.keepAlive), job.keepAlive});
+        }
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {}
+    }
+}
+
+// Mirrors server.js, including its status codes: a route with no taxis is
+// still a 200, malformed bodies are 400 and unknown paths 404.
+string HttpServer::handle(const Job& job, int& status) {
+    const string badRequest = "{\"error\":\"Invalid request body\"}";
+
+    if (job.method == "GET" && job.path == "/health") {
+        return "{\"status\":\"ok\",\"backend\":\"C++ KD-Tree\","
+               "\"message\":\"Server is running and ready to find nearest taxis\"}";
+    }
+    if (job.method == "GET" && job.path == "/metrics") {
+        return metricsJson();
+    }
+
+    if (job.method == "POST" && job.path == "/api/route") {
+        point pickup(0, 0);
+        if (!readPoint(job.body, "pickup", pickup)) {
+            status = 400;
+            return badRequest;
+        }
+        // Optional wider fan-out; the answer still lists the best five by road.
+        int candidates = 5;
+        readNumber(job.body, "candidates", candidates);
+        bool expand = readFlag(job.body, "expand");
+        return engine.route(pickup, min(max(candidates, 1), 50), expand);
+    }
+    if (job.method == "POST" && (job.path == "/api/book-taxi" || job.path == "/api/start-ride")) {
+        bool ride = job.path == "/api/start-ride";
+        point target(0, 0), taxi(0, 0);
+        if (!readPoint(job.body, ride ? "dropoff" : "pickup", target) || !readPoint(job.body, "taxi", taxi)) {
+            status = 400;
+            return badRequest;
+        }
+        return engine.book(target, taxi, ride);
+    }
+    if (job.method == "POST" && job.path == "/api/dispatch") {
+        vector<point> pickups;
+        if (!readPoints(job.body, "pickups", pickups)) {
+            status = 400;
+            return badRequest;
+        }
+        return engine.dispatch(pickups);
+    }
+    if (job.method == "POST" && job.path == "/api/subscribe") {
+        point pickup(0, 0);
+        if (!readPoint(job.body, "pickup", pickup)) {
+            status = 400;
+            return badRequest;
+        }
+        int k = 5;
+        readNumber(job.body, "k", k);
+        return engine.subscribe(pickup, min(max(k, 1), 50));
+    }
+    if (job.method == "POST" && (job.path == "/api/subscription" || job.path == "/api/unsubscribe")) {
+        int id = 0;
+        if (!readNumber(job.body, "subscription", id)) {
+            status = 400;
+            return badRequest;
+        }
+        bool poll = job.path == "/api/subscription";
+        string response = "{\"subscription\":" + to_string(id) + ",\"unsubscribed\":true}";
+        if (poll ? !engine.pollSubscription(id, response) : !engine.unsubscribe(id)) {
+            status = 404;
+            return "{\"error\":\"Unknown subscription\"}";
+        }
+        return response;
+    }
+
+    status = 404;
+    return "{\"error\":\"Not found\"}";
+}
+
+string HttpServer::metricsJson() {
+    ostringstream out;
+    out << "{\"server\":{";
+    out << "\"accepted\":" << accepted << ",";
+    out << "\"activeConnections\":" << active << ",";
+    out << "\"requests\":" << requests << ",";
+    out << "\"keepAliveReuses\":" << keepAliveReuses << ",";
+    out << "\"errors\":" << errors << ",";
+    out << "\"workers\":" << workers.size();
+    out << "},\"engine\":" << engine.metricsJson() << "}";
+    return out.str();
+}
+
+string HttpServer::httpResponse(int status, const string& body, bool keepAlive) {
+    const char* reason = status == 200 ? "OK"
+                       : status == 400 ? "Bad Request"
+                       : status == 404 ? "Not Found"
+                       : status == 413 ? "Payload Too Large"
+                       : "Error";
+
+    ostringstream out;
+    out << "HTTP/1.1 " << status << " " << reason << "\r\n";
+    out << "Content-Type: application/json\r\n";
+    out << "Content-Length: " << body.size() << "\r\n";
+    out << "Access-Control-Allow-Origin: *\r\n";
+    out << "Access-Control-Allow-Methods: POST, GET, OPTIONS\r\n";
+    out << "Access-Control-Allow-Headers: Content-Type\r\n";
+    out << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n\r\n";
+    out << body;
+    return out.str();
+}
+
+#else
+
+HttpServer::HttpServer(TaxiEngine& engine, const HttpServerConfig& config)
+    : engine(engine), config(config), listenFd(-1), epollFd(-1), wakeFd(-1), running(false),
+      nextGeneration(1), requests(0), errors(0), accepted(0), active(0), keepAliveReuses(0) {}
+
+HttpServer::~HttpServer() {}
+
+bool HttpServer::start() {
+    cerr << "The native HTTP server needs Linux (epoll); use server.js instead." << endl;
+    return false;
+}
+
+void HttpServer::run() {}
+
+void HttpServer::stop() {}
+
+#endif
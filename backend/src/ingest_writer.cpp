@@ -0,0 +1,239 @@
+#include "ingest_writer.h"
+#include <chrono>
+
+// Points already in the index stay anonymous until bindTaxi names them.
+IngestWriter::IngestWriter(SpatialIndex& index, size_t capacity, size_t batchSize)
+    : index(index), queue(capacity), batchSize(max<size_t>(1, batchSize)), running(false),
+      enqueued(0), rejected(0), applied(0), coalesced(0), batches(0), maxQueueDepth(0) {
+    vector<point> existing;
+    index.getAllPoints(existing);
+    for (const auto& p : existing) {
+        if (anonymous.insert(p.key()).second) occupancy[p.key()]++;
+    }
+}
+
+IngestWriter::~IngestWriter() {
+    stop();
+}
+
+void IngestWriter::start() {
+    if (running.exchange(true)) return;
+    writer = thread(&IngestWriter::writerLoop, this);
+}
+
+void IngestWriter::stop() {
+    if (!running.exchange(false)) return;
+    if (writer.joinable()) writer.join();
+}
+
+bool IngestWriter::submit(const TaxiUpdate& update) {
+    if (!queue.tryPush(update)) {
+        rejected.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    enqueued.fetch_add(1, memory_order_relaxed);
+
+    size_t depth = queue.size();
+    size_t seen = maxQueueDepth.load(memory_order_relaxed);
+    while (depth > seen && !maxQueueDepth.compare_exchange_weak(seen, depth, memory_order_relaxed)) {}
+    return true;
+}
+
+bool IngestWriter::submit(int taxiId, const point& pos) {
+    return submit(TaxiUpdate(taxiId, pos, UpdateKind::MOVE));
+}
+
+bool IngestWriter::submitRemove(int taxiId) {
+    return submit(TaxiUpdate(taxiId, point(0, 0), UpdateKind::REMOVE));
+}
+
+void IngestWriter::writerLoop() {
+    vector<TaxiUpdate> batch;
+    batch.reserve(batchSize);
+    int idleSpins = 0;
+
+    while (true) {
+        bool stopping = !running.load(memory_order_acquire);
+
+        batch.clear();
+        if (drainBatch(batch) > 0) {
+            applyBatch(batch);
+            idleSpins = 0;
+            continue;
+        }
+
+        if (stopping) break;
+
+        if (++idleSpins < 64) {
+            this_thread::yield();
+        } else {
+            this_thread::sleep_for(chrono::microseconds(200));
+        }
+    }
+}
+
+size_t IngestWriter::drainBatch(vector<TaxiUpdate>& batch) {
+    TaxiUpdate update;
+    while (batch.size() < batchSize && queue.tryPop(update)) {
+        batch.push_back(update);
+    }
+    return batch.size();
+}
+
+void IngestWriter::applyBatch(const vector<TaxiUpdate>& batch) {
+    unordered_map<int, size_t> latest;
+    latest.reserve(batch.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+        latest[batch[i].taxiId] = i;
+    }
+
+    lock_guard<mutex> lock(indexMutex);
+    size_t changed = 0;
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (latest[batch[i].taxiId] != i) continue;
+        if (applyUpdate(batch[i])) changed++;
+    }
+
+    applied.fetch_add(changed, memory_order_relaxed);
+    coalesced.fetch_add(batch.size() - latest.size(), memory_order_relaxed);
+    batches.fetch_add(1, memory_order_relaxed);
+}
+
+// False for updates that leave the index as it was: a repeated position or
+// the removal of a taxi this writer does not track.
+bool IngestWriter::applyUpdate(const TaxiUpdate& update) {
+    auto it = taxiPositions.find(update.taxiId);
+    if (update.kind == UpdateKind::REMOVE) {
+        if (it == taxiPositions.end()) return false;
+        removeTaxi(it->second);
+        taxiPositions.erase(it);
+        return true;
+    }
+
+    // A move is a GPS fix, not a change of state: the taxi keeps the
+    // status, class and capacity it had at its old cell.
+    TaxiAttributes attr;
+    if (it != taxiPositions.end()) {
+        if (it->second == update.pos) return false;
+        index.getAttributes(it->second, attr);
+        removeTaxi(it->second);
+        it->second = update.pos;
+    } else {
+        taxiPositions.emplace(update.taxiId, update.pos);
+        if (update.hasAttr) attr = update.attr;
+    }
+    placeTaxi(update.pos, attr);
+    return true;
+}
+
+// Several taxis may share a cell; the index keeps one point per cell, so it
+// is only inserted for the first taxi and deleted after the last one leaves.
+// A shared cell keeps the attributes of the taxi that got there first.
+void IngestWriter::placeTaxi(const point& p, const TaxiAttributes& attr) {
+    if (occupancy[p.key()]++ == 0) {
+        index.insert(p, attr);
+    }
+}
+
+void IngestWriter::removeTaxi(const point& p) {
+    auto it = occupancy.find(p.key());
+    if (it == occupancy.end()) return;
+    if (--it->second == 0) {
+        occupancy.erase(it);
+        index.deletePoint(p);
+    }
+}
+
+// Applies an update synchronously, bypassing the ring. Used to seed a writer
+// before its thread starts, e.g. when shards are rebuilt.
+void IngestWriter::applyNow(const TaxiUpdate& update) {
+    lock_guard<mutex> lock(indexMutex);
+    if (applyUpdate(update)) applied.fetch_add(1, memory_order_relaxed);
+}
+
+// The taxi takes over the anonymous hold on its cell, or joins the taxis
+// already sharing it.
+bool IngestWriter::bindTaxi(int taxiId, const point& p) {
+    lock_guard<mutex> lock(indexMutex);
+    if (taxiPositions.count(taxiId) || !index.search(p)) return false;
+    if (!anonymous.erase(p.key())) occupancy[p.key()]++;
+    taxiPositions.emplace(taxiId, p);
+    return true;
+}
+
+void IngestWriter::insertPoint(const point& p) {
+    lock_guard<mutex> lock(indexMutex);
+    if (anonymous.insert(p.key()).second) occupancy[p.key()]++;
+    index.insert(p);
+}
+
+void IngestWriter::insertPoint(const point& p, const TaxiAttributes& attr) {
+    lock_guard<mutex> lock(indexMutex);
+    if (anonymous.insert(p.key()).second) occupancy[p.key()]++;
+    index.insert(p, attr);
+}
+
+// Drops the point's hold on its cell; the index point goes once no taxi
+// is left there either.
+bool IngestWriter::deletePoint(const point& p) {
+    lock_guard<mutex> lock(indexMutex);
+    if (!anonymous.erase(p.key())) return false;
+    removeTaxi(p);
+    return true;
+}
+
+// Places a taxi together with its attributes, so a rebuilt shard gets back
+// the status, class and capacity the old one had.
+void IngestWriter::applyNow(const TrackedTaxi& taxi) {
+    applyNow(TaxiUpdate(taxi.taxiId, taxi.pos, taxi.attr));
+}
+
+vector<TrackedTaxi> IngestWriter::taxiSnapshot() {
+    lock_guard<mutex> lock(indexMutex);
+    vector<TrackedTaxi> taxis;
+    taxis.reserve(taxiPositions.size());
+    for (const auto& taxi : taxiPositions) {
+        TaxiAttributes attr;
+        index.getAttributes(taxi.second, attr);
+        taxis.push_back(TrackedTaxi(taxi.first, taxi.second, attr));
+    }
+    return taxis;
+}
+
+bool IngestWriter::attributesOf(int taxiId, TaxiAttributes& attr) {
+    lock_guard<mutex> lock(indexMutex);
+    auto it = taxiPositions.find(taxiId);
+    return it != taxiPositions.end() && index.getAttributes(it->second, attr);
+}
+
+void IngestWriter::anonymousSnapshot(vector<pair<point, TaxiAttributes>>& points) {
+    lock_guard<mutex> lock(indexMutex);
+    vector<pair<point, TaxiAttributes>> all;
+    index.getAllTaxis(all);
+    for (const auto& taxi : all) {
+        if (anonymous.count(taxi.first.key())) points.push_back(taxi);
+    }
+}
+
+void IngestWriter::withIndex(const function<void(SpatialIndex&)>& fn) {
+    lock_guard<mutex> lock(indexMutex);
+    fn(index);
+}
+
+vector<point> IngestWriter::kNearestNeighbors(const point& query, int k, const TaxiFilter& filter) {
+    lock_guard<mutex> lock(indexMutex);
+    return index.kNearestNeighbors(query, k, filter);
+}
+
+IngestMetrics IngestWriter::metrics() const {
+    IngestMetrics m;
+    m.enqueued = enqueued.load(memory_order_relaxed);
+    m.rejected = rejected.load(memory_order_relaxed);
+    m.applied = applied.load(memory_order_relaxed);
+    m.coalesced = coalesced.load(memory_order_relaxed);
+    m.batches = batches.load(memory_order_relaxed);
+    m.queueDepth = queue.size();
+    m.maxQueueDepth = maxQueueDepth.load(memory_order_relaxed);
+    m.capacity = queue.capacity();
+    return m;
+}
@@ -0,0 +1,230 @@
+#include "knn_subscriptions.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static const long long MAX_REGISTERED_CELLS = 4096;
+
+KnnSubscriptionManager::KnnSubscriptionManager(SpatialIndex& index, int cellSize)
+    : index(index), cellSize(max(1, cellSize)), nextId(1), recomputations(0), incrementalUpdates(0) {}
+
+void KnnSubscriptionManager::eraseId(vector<int>& ids, int id) {
+    auto it = find(ids.begin(), ids.end(), id);
+    if (it == ids.end()) return;
+    *it = ids.back();
+    ids.pop_back();
+}
+
+int KnnSubscriptionManager::cellOf(int v) const {
+    return v >= 0 ? v / cellSize : -((-v + cellSize - 1) / cellSize);
+}
+
+// A subscription is reachable through every taxi in its answer and through
+// every cell its safe-radius square overlaps. Subscriptions with fewer than
+// k matches (or a radius too large to register cell by cell) are checked on
+// every change.
+void KnnSubscriptionManager::registerSubscription(Subscription& sub) {
+    for (const auto& p : sub.current) {
+        memberSubscriptions[p.key()].push_back(sub.id);
+    }
+
+    sub.unbounded = (int)sub.current.size() < sub.k;
+    if (!sub.unbounded) {
+        sub.cellX0 = cellOf((int)floor(sub.pickup.x - sub.radius));
+        sub.cellX1 = cellOf((int)ceil(sub.pickup.x + sub.radius));
+        sub.cellY0 = cellOf((int)floor(sub.pickup.y - sub.radius));
+        sub.cellY1 = cellOf((int)ceil(sub.pickup.y + sub.radius));
+        long long cells = (long long)(sub.cellX1 - sub.cellX0 + 1) * (sub.cellY1 - sub.cellY0 + 1);
+        sub.unbounded = cells > MAX_REGISTERED_CELLS;
+    }
+
+    if (sub.unbounded) {
+        unboundedSubscriptions.push_back(sub.id);
+        return;
+    }
+
+    for (int cx = sub.cellX0; cx <= sub.cellX1; cx++) {
+        for (int cy = sub.cellY0; cy <= sub.cellY1; cy++) {
+            cellSubscriptions[packCoords(cx, cy)].push_back(sub.id);
+        }
+    }
+}
+
+void KnnSubscriptionManager::unregisterSubscription(Subscription& sub) {
+    for (const auto& p : sub.current) {
+        auto it = memberSubscriptions.find(p.key());
+        if (it == memberSubscriptions.end()) continue;
+        eraseId(it->second, sub.id);
+        if (it->second.empty()) memberSubscriptions.erase(it);
+    }
+
+    if (sub.unbounded) {
+        eraseId(unboundedSubscriptions, sub.id);
+        return;
+    }
+
+    for (int cx = sub.cellX0; cx <= sub.cellX1; cx++) {
+        for (int cy = sub.cellY0; cy <= sub.cellY1; cy++) {
+            auto it = cellSubscriptions.find(packCoords(cx, cy));
+            if (it == cellSubscriptions.end()) continue;
+            eraseId(it->second, sub.id);
+            if (it->second.empty()) cellSubscriptions.erase(it);
+        }
+    }
+}
+
+void KnnSubscriptionManager::refreshRadius(Subscription& sub) {
+    sort(sub.current.begin(), sub.current.end(), [&sub](const point& a, const point& b) {
+        return a.distanceSquared(sub.pickup) < b.distanceSquared(sub.pickup);
+    });
+    if ((int)sub.current.size() > sub.k) sub.current.resize(sub.k, sub.pickup);
+    sub.radius = (int)sub.current.size() < sub.k ? numeric_limits<double>::max()
+                                                 : sub.current.back().distance(sub.pickup);
+}
+
+void KnnSubscriptionManager::recompute(Subscription& sub) {
+    sub.current = index.kNearestNeighbors(sub.pickup, sub.k, sub.filter);
+    refreshRadius(sub);
+    recomputations++;
+}
+
+bool KnnSubscriptionManager::contains(const Subscription& sub, const point& p) const {
+    return find(sub.current.begin(), sub.current.end(), p) != sub.current.end();
+}
+
+bool KnnSubscriptionManager::eligible(const Subscription& sub, const point& p) {
+    TaxiAttributes attr;
+    return index.getAttributes(p, attr) && sub.filter.matches(attr);
+}
+
+bool KnnSubscriptionManager::update(Subscription& sub, const point* from, const point* to, KnnDelta& delta) {
+    bool wasMember = from && contains(sub, *from);
+    bool canEnter = to && eligible(sub, *to);
+    bool full = (int)sub.current.size() >= sub.k;
+    double toDist = to ? to->distance(sub.pickup) : 0;
+
+    // A member moving onto another member's cell merges with it there, so
+    // the answer is a taxi short and goes through recompute below.
+    bool merges = wasMember && to && !(*to == *from) && contains(sub, *to);
+    bool stays = wasMember && canEnter && !merges && (!full || toDist <= sub.radius);
+    bool enters = !wasMember && canEnter && !contains(sub, *to) && (!full || toDist < sub.radius);
+    if (!wasMember && !enters) return false;
+
+    vector<point> before = sub.current;
+    unregisterSubscription(sub);
+
+    if (stays) {
+        // Still no farther than the old k-th taxi, so nothing outside the
+        // answer can have overtaken it.
+        *find(sub.current.begin(), sub.current.end(), *from) = *to;
+        refreshRadius(sub);
+        incrementalUpdates++;
+    } else if (enters) {
+        sub.current.push_back(*to);
+        refreshRadius(sub);
+        incrementalUpdates++;
+    } else {
+        recompute(sub);
+    }
+
+    registerSubscription(sub);
+
+    delta.subscriptionId = sub.id;
+    for (const auto& p : sub.current) {
+        if (find(before.begin(), before.end(), p) == before.end()) delta.added.push_back(p);
+    }
+    for (const auto& p : before) {
+        if (!contains(sub, p)) delta.removed.push_back(p);
+    }
+    return !delta.added.empty() || !delta.removed.empty();
+}
+
+vector<KnnDelta> KnnSubscriptionManager::process(const point* from, const point* to) {
+    vector<int> candidates(unboundedSubscriptions);
+
+    if (from) {
+        auto it = memberSubscriptions.find(from->key());
+        if (it != memberSubscriptions.end()) {
+            candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+        }
+    }
+    if (to) {
+        auto it = cellSubscriptions.find(packCoords(cellOf(to->x), cellOf(to->y)));
+        if (it != cellSubscriptions.end()) {
+            candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+        }
+    }
+
+    sort(candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+    vector<KnnDelta> deltas;
+    for (int id : candidates) {
+        auto it = subscriptions.find(id);
+        if (it == subscriptions.end()) continue;
+
+        KnnDelta delta;
+        if (update(it->second, from, to, delta)) {
+            deltas.push_back(delta);
+        }
+    }
+    return deltas;
+}
+
+int KnnSubscriptionManager::subscribe(const point& pickup, int k, const TaxiFilter& filter) {
+    Subscription sub;
+    sub.id = nextId++;
+    sub.pickup = pickup;
+    sub.k = max(1, k);
+    sub.filter = filter;
+    recompute(sub);
+
+    Subscription& stored = subscriptions.emplace(sub.id, sub).first->second;
+    registerSubscription(stored);
+    return stored.id;
+}
+
+void KnnSubscriptionManager::unsubscribe(int id) {
+    auto it = subscriptions.find(id);
+    if (it == subscriptions.end()) return;
+    unregisterSubscription(it->second);
+    subscriptions.erase(it);
+}
+
+bool KnnSubscriptionManager::hasSubscription(int id) const {
+    return subscriptions.count(id) > 0;
+}
+
+vector<point> KnnSubscriptionManager::current(int id) const {
+    auto it = subscriptions.find(id);
+    if (it == subscriptions.end()) return vector<point>();
+    return it->second.current;
+}
+
+size_t KnnSubscriptionManager::subscriptionCount() const {
+    return subscriptions.size();
+}
+
+vector<KnnDelta> KnnSubscriptionManager::onTaxiMoved(const point& from, const point& to) {
+    return process(&from, &to);
+}
+
+vector<KnnDelta> KnnSubscriptionManager::onTaxiAdded(const point& at) {
+    return process(nullptr, &at);
+}
+
+vector<KnnDelta> KnnSubscriptionManager::onTaxiRemoved(const point& from) {
+    return process(&from, nullptr);
+}
+
+vector<KnnDelta> KnnSubscriptionManager::onTaxiStatusChanged(const point& at) {
+    return process(&at, &at);
+}
+
+size_t KnnSubscriptionManager::recomputationCount() const {
+    return recomputations;
+}
+
+size_t KnnSubscriptionManager::incrementalUpdateCount() const {
+    return incrementalUpdates;
+}
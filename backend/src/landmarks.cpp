@@ -0,0 +1,321 @@
+#include "landmarks.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <queue>
+
+LandmarkTable::LandmarkTable() : originX(0), originY(0), width(0), height(0), graphHash(0) {}
+
+static int manhattan(const pair<int, int>& a, const pair<int, int>& b) {
+    return abs(a.first - b.first) + abs(a.second - b.second);
+}
+
+// Sorted node list, CSR adjacency and a hash over both, so the same road
+// network always gets the same indexes and fingerprint. Road networks fill
+// most of their bounding box, so nodes are found through a dense cell array
+// and only scattered graphs fall back to binary search.
+void LandmarkTable::indexGraph(const GridGraph& graph) {
+    nodes.clear();
+    cells.clear();
+
+    nodes.reserve(graph.adjacencyList.size());
+    for (const auto& entry : graph.adjacencyList) nodes.push_back(entry.first);
+    sort(nodes.begin(), nodes.end());
+
+    width = height = 0;
+    if (!nodes.empty()) {
+        long long minY = nodes[0].second, maxY = minY;
+        for (const auto& node : nodes) {
+            minY = min(minY, (long long)node.second);
+            maxY = max(maxY, (long long)node.second);
+        }
+        long long w = (long long)nodes.back().first - nodes[0].first + 1, h = maxY - minY + 1;
+        if (w * h <= 4 * (long long)nodes.size() + 1024) {
+            originX = nodes[0].first;
+            originY = minY;
+            width = w;
+            height = h;
+            cells.assign(w * h, -1);
+            for (size_t i = 0; i < nodes.size(); i++) {
+                cells[(size_t)(nodes[i].first - originX) * height + (nodes[i].second - originY)] = i;
+            }
+        }
+    }
+
+    // CSR straight from the adjacency lists, without a lookup per node.
+    int n = nodes.size();
+    offsets.assign(n + 1, 0);
+    for (const auto& entry : graph.adjacencyList) offsets[lookup(entry.first) + 1] = entry.second.size();
+    for (int v = 0; v < n; v++) offsets[v + 1] += offsets[v];
+    targets.resize(offsets[n]);
+    for (const auto& entry : graph.adjacencyList) {
+        int at = offsets[lookup(entry.first)];
+        for (const auto& neighbor : entry.second) targets[at++] = lookup(neighbor);
+    }
+
+    unsigned long long h = 1469598103934665603ULL;
+    auto mix = [&h](long long value) {
+        h = (h ^ (unsigned long long)value) * 1099511628211ULL;
+        h ^= h >> 29;
+    };
+    mix(n);
+
+    // Rows sorted and deduplicated in place, which also makes the
+    // fingerprint independent of edge insertion order.
+    int written = 0;
+    for (int v = 0; v < n; v++) {
+        int begin = offsets[v], end = offsets[v + 1];
+        sort(targets.begin() + begin, targets.begin() + end);
+        offsets[v] = written;
+        mix(nodes[v].first);
+        mix(nodes[v].second);
+        for (int e = begin; e < end; e++) {
+            if (e > begin && targets[e] == targets[e - 1]) continue;
+            targets[written++] = targets[e];
+            mix(targets[e]);
+        }
+        mix(-1);
+    }
+    offsets[n] = written;
+    targets.resize(written);
+    graphHash = h;
+}
+
+void LandmarkTable::breadthFirst(int source, vector<int>& dist) const {
+    dist.assign(nodes.size(), -1);
+    vector<int> frontier;
+    frontier.reserve(nodes.size());
+    dist[source] = 0;
+    frontier.push_back(source);
+    for (size_t head = 0; head < frontier.size(); head++) {
+        int v = frontier[head];
+        for (int e = offsets[v]; e < offsets[v + 1]; e++) {
+            int u = targets[e];
+            if (dist[u] >= 0) continue;
+            dist[u] = dist[v] + 1;
+            frontier.push_back(u);
+        }
+    }
+}
+
+void LandmarkTable::build(const GridGraph& graph, int count) {
+    indexGraph(graph);
+    landmarks.clear();
+    distances.clear();
+    int n = nodes.size();
+    if (n == 0 || count <= 0) return;
+
+    // Road distance to the closest landmark so far, seeded from node 0 so
+    // the first landmark lands on the far side of the network.
+    vector<int> closest;
+    breadthFirst(0, closest);
+    for (int& d : closest) {
+        if (d < 0) d = INT_MAX;
+    }
+
+    vector<vector<uint16_t>> columns;
+    vector<int> dist;
+    while ((int)landmarks.size() < min(count, n)) {
+        int farthest = max_element(closest.begin(), closest.end()) - closest.begin();
+        if (closest[farthest] == 0) break;
+
+        breadthFirst(farthest, dist);
+        vector<uint16_t> column(n);
+        for (int v = 0; v < n; v++) {
+            if (dist[v] < 0) {
+                column[v] = UNREACHABLE;
+                continue;
+            }
+            // Clamping to FARTHEST only ever shrinks a difference, so the
+            // bound stays admissible on very large graphs.
+            column[v] = (uint16_t)min(dist[v], (int)FARTHEST);
+            closest[v] = min(closest[v], dist[v]);
+        }
+        landmarks.push_back(farthest);
+        columns.push_back(column);
+    }
+
+    int stored = landmarks.size();
+    distances.resize((size_t)n * stored);
+    for (int l = 0; l < stored; l++) {
+        for (int v = 0; v < n; v++) distances[(size_t)v * stored + l] = columns[l][v];
+    }
+}
+
+bool LandmarkTable::save(const string& path) const {
+    ofstream out(path, ios::binary);
+    if (!out.is_open()) return false;
+
+    uint32_t n = nodes.size(), count = landmarks.size();
+    out.write("ALT1", 4);
+    out.write((const char*)&graphHash, sizeof(graphHash));
+    out.write((const char*)&n, sizeof(n));
+    out.write((const char*)&count, sizeof(count));
+    for (int l : landmarks) {
+        uint32_t index = l;
+        out.write((const char*)&index, sizeof(index));
+    }
+    out.write((const char*)distances.data(), distances.size() * sizeof(uint16_t));
+    return (bool)out;
+}
+
+bool LandmarkTable::load(const string& path, const GridGraph& graph) {
+    ifstream in(path, ios::binary);
+    if (!in.is_open()) return false;
+
+    char magic[4];
+    unsigned long long hash;
+    uint32_t n, count;
+    in.read(magic, 4);
+    in.read((char*)&hash, sizeof(hash));
+    in.read((char*)&n, sizeof(n));
+    in.read((char*)&count, sizeof(count));
+    if (!in || memcmp(magic, "ALT1", 4) != 0) return false;
+
+    indexGraph(graph);
+    if (hash != graphHash || n != nodes.size() || count > n) return false;
+
+    landmarks.assign(count, 0);
+    for (uint32_t l = 0; l < count; l++) {
+        uint32_t index;
+        in.read((char*)&index, sizeof(index));
+        if (!in || index >= n) return false;
+        landmarks[l] = index;
+    }
+    distances.assign((size_t)n * count, 0);
+    in.read((char*)distances.data(), distances.size() * sizeof(uint16_t));
+    return (bool)in;
+}
+
+int LandmarkTable::lookup(const pair<int, int>& node) const {
+    if (!cells.empty()) {
+        long long x = (long long)node.first - originX, y = (long long)node.second - originY;
+        if (x < 0 || x >= width || y < 0 || y >= height) return -1;
+        return cells[(size_t)x * height + y];
+    }
+    auto it = lower_bound(nodes.begin(), nodes.end(), node);
+    return it == nodes.end() || *it != node ? -1 : it - nodes.begin();
+}
+
+int LandmarkTable::bound(int from, int to) const {
+    int count = landmarks.size();
+    const uint16_t* a = distances.data() + (size_t)from * count;
+    const uint16_t* b = distances.data() + (size_t)to * count;
+    int best = manhattan(nodes[from], nodes[to]);
+    for (int l = 0; l < count; l++) {
+        if (a[l] == UNREACHABLE || b[l] == UNREACHABLE) continue;
+        best = max(best, abs((int)a[l] - (int)b[l]));
+    }
+    return best;
+}
+
+int LandmarkTable::lowerBound(const pair<int, int>& from, const pair<int, int>& to) const {
+    int a = lookup(from), b = lookup(to);
+    if (a < 0 || b < 0) return manhattan(from, to);
+    return bound(a, b);
+}
+
+// One per thread, since tables are shared read-only between threads. The
+// stamp marks which entries belong to the current search, so nothing is
+// cleared or reallocated between searches on graphs of similar size.
+thread_local LandmarkTable::SearchScratch LandmarkTable::searchScratch;
+
+void LandmarkTable::SearchScratch::begin(size_t n) {
+    if (dist.size() < n) {
+        dist.resize(n);
+        previous.resize(n);
+        seen.resize(n, 0);
+        closed.resize(n, 0);
+    }
+    if (++stamp == 0) {
+        fill(seen.begin(), seen.end(), 0);
+        fill(closed.begin(), closed.end(), 0);
+        stamp = 1;
+    }
+    open.clear();
+}
+
+int LandmarkTable::SearchScratch::distance(int v) const {
+    return seen[v] == stamp ? dist[v] : INT_MAX;
+}
+
+void LandmarkTable::SearchScratch::reach(int v, int d, int from) {
+    seen[v] = stamp;
+    dist[v] = d;
+    previous[v] = from;
+}
+
+int LandmarkTable::search(const pair<int, int>& from, const pair<int, int>& to, RunLengthPath* path) const {
+    if (path) *path = RunLengthPath(from);
+    int s = lookup(from), t = lookup(to);
+    if (s < 0 || t < 0) return -1;
+    if (s == t) return 0;
+
+    int count = landmarks.size();
+    for (int l = 0; l < count; l++) {
+        bool reachesS = distances[(size_t)s * count + l] != UNREACHABLE;
+        bool reachesT = distances[(size_t)t * count + l] != UNREACHABLE;
+        if (reachesS != reachesT) return -1;
+    }
+
+    // Both bounds are consistent on unit edges, so a node is final the first
+    // time it leaves the queue.
+    SearchScratch& scratch = searchScratch;
+    scratch.begin(nodes.size());
+    vector<pair<int, int>>& open = scratch.open;
+    greater<pair<int, int>> later;
+    scratch.reach(s, 0, -1);
+    open.push_back({bound(s, t), s});
+
+    while (!open.empty()) {
+        pop_heap(open.begin(), open.end(), later);
+        int v = open.back().second;
+        open.pop_back();
+        if (scratch.closed[v] == scratch.stamp) continue;
+        scratch.closed[v] = scratch.stamp;
+        if (v == t) break;
+
+        int next = scratch.dist[v] + 1;
+        for (int e = offsets[v]; e < offsets[v + 1]; e++) {
+            int u = targets[e];
+            if (scratch.closed[u] == scratch.stamp || next >= scratch.distance(u)) continue;
+            scratch.reach(u, next, v);
+            open.push_back({next + bound(u, t), u});
+            push_heap(open.begin(), open.end(), later);
+        }
+    }
+
+    int distance = scratch.distance(t);
+    if (distance == INT_MAX) return -1;
+    if (path) {
+        RunLengthPath back(to);
+        for (int v = t; scratch.previous[v] != -1; v = scratch.previous[v]) {
+            const pair<int, int>& before = nodes[scratch.previous[v]];
+            back.step(before.first - nodes[v].first, before.second - nodes[v].second);
+        }
+        *path = back.reversed();
+    }
+    return distance;
+}
+
+int LandmarkTable::landmarkCount() const {
+    return landmarks.size();
+}
+
+size_t LandmarkTable::nodeCount() const {
+    return nodes.size();
+}
+
+vector<pair<int, int>> LandmarkTable::getLandmarks() const {
+    vector<pair<int, int>> result;
+    for (int l : landmarks) result.push_back(nodes[l]);
+    return result;
+}
+
+unsigned long long LandmarkTable::fingerprint(const GridGraph& graph) {
+    LandmarkTable table;
+    table.indexGraph(graph);
+    return table.graphHash;
+}
@@ -0,0 +1,137 @@
+#include "reverse_knn.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+ReverseKnnIndex::ReverseKnnIndex(SpatialIndex& taxis, int k, const TaxiFilter& filter)
+    : taxis(taxis), k(max(1, k)), filter(filter), nextId(1), examined(0) {
+    for (int b = 0; b < BANDS; b++) {
+        bands[b].reset(new DynamicKDTree());
+        bandSizes[b] = 0;
+    }
+}
+
+// Band b holds radii in [2^(b-1), 2^b); band 0 everything below 1.
+int ReverseKnnIndex::bandOf(double radiusSquared) {
+    double r = sqrt(radiusSquared);
+    if (r < 1.0) return 0;
+    return min(BANDS - 1, (int)floor(log2(r)) + 1);
+}
+
+void ReverseKnnIndex::eraseId(vector<int>& ids, int id) {
+    auto it = find(ids.begin(), ids.end(), id);
+    if (it == ids.end()) return;
+    *it = ids.back();
+    ids.pop_back();
+}
+
+// Radius from the rider's current k-th matching taxi. Several riders may
+// wait at one pickup; the band tree holds the point once.
+void ReverseKnnIndex::place(int id, Rider& rider) {
+    vector<point> nearest = taxis.kNearestNeighbors(rider.pickup, k, filter);
+    rider.unbounded = (int)nearest.size() < k;
+    if (rider.unbounded) {
+        rider.band = -1;
+        unboundedRiders.push_back(id);
+        return;
+    }
+
+    rider.radiusSquared = nearest.back().distanceSquared(rider.pickup);
+    rider.band = bandOf(rider.radiusSquared);
+    vector<int>& here = bandRiders[rider.band][rider.pickup.key()];
+    if (here.empty()) bands[rider.band]->insert(rider.pickup);
+    here.push_back(id);
+    bandSizes[rider.band]++;
+}
+
+void ReverseKnnIndex::unplace(int id, Rider& rider) {
+    if (rider.unbounded) {
+        eraseId(unboundedRiders, id);
+        return;
+    }
+
+    auto it = bandRiders[rider.band].find(rider.pickup.key());
+    if (it == bandRiders[rider.band].end()) return;
+    eraseId(it->second, id);
+    if (it->second.empty()) {
+        bands[rider.band]->deletePoint(rider.pickup);
+        bandRiders[rider.band].erase(it);
+    }
+    bandSizes[rider.band]--;
+}
+
+void ReverseKnnIndex::refresh(int id) {
+    Rider& rider = riders[id];
+    unplace(id, rider);
+    place(id, rider);
+}
+
+int ReverseKnnIndex::addRider(const point& pickup) {
+    int id = nextId++;
+    Rider& rider = riders[id];
+    rider.pickup = pickup;
+    place(id, rider);
+    return id;
+}
+
+bool ReverseKnnIndex::removeRider(int id) {
+    auto it = riders.find(id);
+    if (it == riders.end()) return false;
+    unplace(id, it->second);
+    riders.erase(it);
+    return true;
+}
+
+size_t ReverseKnnIndex::riderCount() const {
+    return riders.size();
+}
+
+double ReverseKnnIndex::radius(int id) const {
+    auto it = riders.find(id);
+    if (it == riders.end() || it->second.unbounded) return HUGE_VAL;
+    return sqrt(it->second.radiusSquared);
+}
+
+// Strictly inside a radius the taxi joins the set; on it, it may already be
+// the k-th member, which is what a removal has to catch.
+vector<int> ReverseKnnIndex::reachedBy(const point& taxi, bool inclusive) {
+    vector<int> result(unboundedRiders);
+    examined += unboundedRiders.size();
+
+    for (int b = 0; b < BANDS; b++) {
+        if (bandSizes[b] == 0) continue;
+        long long reach = 1LL << b;
+        point low((int)max((long long)INT_MIN, taxi.x - reach), (int)max((long long)INT_MIN, taxi.y - reach));
+        point high((int)min((long long)INT_MAX, taxi.x + reach), (int)min((long long)INT_MAX, taxi.y + reach));
+
+        for (const auto& pickup : bands[b]->rangeSearch(low, high)) {
+            double d = pickup.distanceSquared(taxi);
+            for (int id : bandRiders[b][pickup.key()]) {
+                examined++;
+                double r = riders[id].radiusSquared;
+                if (d < r || (inclusive && d == r)) result.push_back(id);
+            }
+        }
+    }
+    return result;
+}
+
+vector<int> ReverseKnnIndex::ridersJoinedBy(const point& taxi) {
+    return reachedBy(taxi, false);
+}
+
+vector<int> ReverseKnnIndex::onTaxiAvailable(const point& taxi) {
+    vector<int> joined = reachedBy(taxi, false);
+    for (int id : joined) refresh(id);
+    return joined;
+}
+
+void ReverseKnnIndex::onTaxiUnavailable(const point& taxi) {
+    for (int id : reachedBy(taxi, true)) {
+        if (!riders[id].unbounded) refresh(id);
+    }
+}
+
+size_t ReverseKnnIndex::candidatesExamined() const {
+    return examined;
+}
@@ -0,0 +1,143 @@
+#include "route_cache.h"
+#include <algorithm>
+#include <cmath>
+
+// Regions a bounded entry may depend on before it is tied to the global
+// version instead.
+static const long long MAX_REGIONS = 64;
+
+RouteCache::RouteCache(int cellSize, int regionSize, size_t capacity)
+    : cellSize(max(1, cellSize)), regionSize(max(1, regionSize)), capacity(max((size_t)1, capacity)),
+      bytes(0), globalVersion(0), hits(0), misses(0), invalidations(0), evictions(0), regionBumps(0) {}
+
+int RouteCache::floorDiv(int v, int size) {
+    return v >= 0 ? v / size : -((-v + size - 1) / size);
+}
+
+long long RouteCache::keyFor(int cellX, int cellY, int k) const {
+    return (long long)((unsigned long long)packCoords(cellX, cellY) * 31 + (unsigned int)k);
+}
+
+unsigned long long RouteCache::versionOf(long long region) const {
+    auto it = regionVersions.find(region);
+    return it == regionVersions.end() ? 0 : it->second;
+}
+
+bool RouteCache::valid(const Entry& entry) const {
+    if (entry.global) return entry.globalVersion == globalVersion;
+    for (const auto& region : entry.regions) {
+        if (versionOf(region.first) != region.second) return false;
+    }
+    return true;
+}
+
+void RouteCache::erase(list<Entry>::iterator it) {
+    bytes -= it->bytes;
+    index.erase(it->key);
+    entries.erase(it);
+}
+
+bool RouteCache::lookup(const point& pickup, int k, string& response) {
+    lock_guard<mutex> guard(lock);
+    int cellX = floorDiv(pickup.x, cellSize);
+    int cellY = floorDiv(pickup.y, cellSize);
+
+    auto it = index.find(keyFor(cellX, cellY, k));
+    if (it == index.end() || it->second->cellX != cellX || it->second->cellY != cellY || it->second->k != k) {
+        misses++;
+        return false;
+    }
+
+    if (!valid(*it->second)) {
+        erase(it->second);
+        invalidations++;
+        misses++;
+        return false;
+    }
+
+    entries.splice(entries.begin(), entries, it->second);
+    response = it->second->response;
+    hits++;
+    return true;
+}
+
+// radius is the distance to the k-th taxi, or infinite if fewer were found.
+RouteCacheStamp RouteCache::stamp(const point& pickup, int k, double radius) const {
+    lock_guard<mutex> guard(lock);
+
+    RouteCacheStamp stamp;
+    stamp.cellX = floorDiv(pickup.x, cellSize);
+    stamp.cellY = floorDiv(pickup.y, cellSize);
+    stamp.k = k;
+    stamp.global = true;
+    stamp.globalVersion = globalVersion;
+
+    if (std::isfinite(radius)) {
+        int r = (int)ceil(radius);
+        int x0 = floorDiv(pickup.x - r, regionSize), x1 = floorDiv(pickup.x + r, regionSize);
+        int y0 = floorDiv(pickup.y - r, regionSize), y1 = floorDiv(pickup.y + r, regionSize);
+        if ((long long)(x1 - x0 + 1) * (y1 - y0 + 1) <= MAX_REGIONS) {
+            stamp.global = false;
+            for (int rx = x0; rx <= x1; rx++) {
+                for (int ry = y0; ry <= y1; ry++) {
+                    long long region = packCoords(rx, ry);
+                    stamp.regions.push_back({region, versionOf(region)});
+                }
+            }
+        }
+    }
+    return stamp;
+}
+
+// An answer whose regions moved on since its stamp is stored anyway and
+// simply fails its first lookup.
+void RouteCache::store(const RouteCacheStamp& stamp, const string& response) {
+    lock_guard<mutex> guard(lock);
+
+    Entry entry;
+    entry.cellX = stamp.cellX;
+    entry.cellY = stamp.cellY;
+    entry.k = stamp.k;
+    entry.key = keyFor(entry.cellX, entry.cellY, entry.k);
+    entry.response = response;
+    entry.global = stamp.global;
+    entry.globalVersion = stamp.globalVersion;
+    entry.regions = stamp.regions;
+
+    auto it = index.find(entry.key);
+    if (it != index.end()) erase(it->second);
+
+    // Payload plus node, region list and index slot; close enough to keep
+    // the budget honest without asking the allocator.
+    entry.bytes = sizeof(Entry) + response.size() + entry.regions.size() * sizeof(entry.regions[0]) +
+                  sizeof(long long) + 4 * sizeof(void*);
+    if (entry.bytes > capacity) return;
+
+    bytes += entry.bytes;
+    entries.push_front(move(entry));
+    index[entries.front().key] = entries.begin();
+
+    while (bytes > capacity) {
+        erase(prev(entries.end()));
+        evictions++;
+    }
+}
+
+void RouteCache::onTaxiChanged(const point& at) {
+    lock_guard<mutex> guard(lock);
+    regionVersions[packCoords(floorDiv(at.x, regionSize), floorDiv(at.y, regionSize))]++;
+    globalVersion++;
+    regionBumps++;
+}
+
+void RouteCache::clear() {
+    lock_guard<mutex> guard(lock);
+    entries.clear();
+    index.clear();
+    bytes = 0;
+}
+
+RouteCacheMetrics RouteCache::metrics() const {
+    lock_guard<mutex> guard(lock);
+    return {hits, misses, invalidations, evictions, regionBumps, entries.size(), bytes};
+}
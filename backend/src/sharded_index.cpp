@@ -0,0 +1,371 @@
+#include "sharded_index.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <thread>
+
+ShardedIndex::ShardedIndex(const ShardConfig& config)
+    : config(config), taxiShard(max(1, config.maxTaxis)), migrations(0) {
+    this->config.cols = max(1, config.cols);
+    this->config.rows = max(1, config.rows);
+    for (auto& s : taxiShard) s.store(-1, memory_order_relaxed);
+
+    if ((int)config.xSplits.size() == this->config.cols - 1 &&
+        (int)config.ySplits.size() == this->config.cols) {
+        xSplits = config.xSplits;
+        ySplits = config.ySplits;
+        for (auto& column : ySplits) column.resize(this->config.rows - 1, this->config.maxCoord);
+    } else {
+        layoutUniform();
+    }
+
+    populate({}, {});
+    startWriters();
+}
+
+ShardedIndex::~ShardedIndex() {
+    stopWriters();
+}
+
+int ShardedIndex::shardFor(const point& p) const {
+    int col = upper_bound(xSplits.begin(), xSplits.end(), p.x) - xSplits.begin();
+    const vector<int>& column = ySplits[col];
+    int row = upper_bound(column.begin(), column.end(), p.y) - column.begin();
+    return col * config.rows + row;
+}
+
+double ShardedIndex::tileDistance(const Shard& shard, const point& query) const {
+    double dx = max({(double)shard.minX - query.x, 0.0, (double)query.x - shard.maxX});
+    double dy = max({(double)shard.minY - query.y, 0.0, (double)query.y - shard.maxY});
+    return sqrt(dx * dx + dy * dy);
+}
+
+void ShardedIndex::layoutUniform() {
+    int span = config.maxCoord - config.minCoord + 1;
+    xSplits.clear();
+    for (int c = 1; c < config.cols; c++) {
+        xSplits.push_back(config.minCoord + span * c / config.cols);
+    }
+    vector<int> rowSplits;
+    for (int r = 1; r < config.rows; r++) {
+        rowSplits.push_back(config.minCoord + span * r / config.rows);
+    }
+    ySplits.assign(config.cols, rowSplits);
+}
+
+// Column splits are x-quantiles of the fleet and each column gets its own
+// y-quantile row splits, so every tile holds roughly the same number of taxis.
+void ShardedIndex::layoutFromPoints(vector<point> points) {
+    if (points.empty()) {
+        layoutUniform();
+        return;
+    }
+
+    sort(points.begin(), points.end(), [](const point& a, const point& b) {
+        return a.x != b.x ? a.x < b.x : a.y < b.y;
+    });
+
+    int n = points.size();
+    xSplits.clear();
+    for (int c = 1; c < config.cols; c++) {
+        xSplits.push_back(points[(long long)n * c / config.cols].x);
+    }
+
+    ySplits.assign(config.cols, vector<int>());
+    int begin = 0;
+    for (int c = 0; c < config.cols; c++) {
+        int end = begin;
+        while (end < n && (c == config.cols - 1 || points[end].x < xSplits[c])) end++;
+
+        vector<int> ys;
+        for (int i = begin; i < end; i++) ys.push_back(points[i].y);
+        sort(ys.begin(), ys.end());
+
+        for (int r = 1; r < config.rows; r++) {
+            ySplits[c].push_back(ys.empty() ? config.maxCoord
+                                            : ys[(long long)ys.size() * r / config.rows]);
+        }
+        begin = end;
+    }
+}
+
+void ShardedIndex::populate(const vector<pair<point, TaxiAttributes>>& anonymous,
+                            const vector<TrackedTaxi>& taxis) {
+    shards.clear();
+    shards.resize(config.cols * config.rows);
+
+    for (int c = 0; c < config.cols; c++) {
+        for (int r = 0; r < config.rows; r++) {
+            Shard& shard = shards[c * config.rows + r];
+            shard.minX = c == 0 ? INT_MIN : xSplits[c - 1];
+            shard.maxX = c == config.cols - 1 ? INT_MAX : xSplits[c] - 1;
+            shard.minY = r == 0 ? INT_MIN : ySplits[c][r - 1];
+            shard.maxY = r == config.rows - 1 ? INT_MAX : ySplits[c][r] - 1;
+        }
+    }
+
+    vector<vector<point>> buckets(shards.size());
+    vector<vector<TaxiAttributes>> bucketAttrs(shards.size());
+    for (const auto& taxi : anonymous) {
+        int home = shardFor(taxi.first);
+        buckets[home].push_back(taxi.first);
+        bucketAttrs[home].push_back(taxi.second);
+    }
+
+    for (size_t i = 0; i < shards.size(); i++) {
+        shards[i].tree.reset(new DynamicKDTree());
+        shards[i].tree->buildFromVector(buckets[i], bucketAttrs[i]);
+        shards[i].writer.reset(new IngestWriter(*shards[i].tree, config.queueCapacity, config.batchSize));
+    }
+
+    for (auto& s : taxiShard) s.store(-1, memory_order_relaxed);
+    for (const auto& taxi : taxis) {
+        int home = shardFor(taxi.pos);
+        shards[home].writer->applyNow(taxi);
+        taxiShard[taxi.taxiId].store(home, memory_order_relaxed);
+    }
+}
+
+void ShardedIndex::startWriters() {
+    for (auto& shard : shards) shard.writer->start();
+}
+
+void ShardedIndex::stopWriters() {
+    for (auto& shard : shards) {
+        if (shard.writer) shard.writer->stop();
+    }
+}
+
+bool ShardedIndex::bindTaxi(int taxiId, const point& p) {
+    if (taxiId < 0 || taxiId >= (int)taxiShard.size() || taxiShard[taxiId].load(memory_order_acquire) >= 0) {
+        return false;
+    }
+    int home = shardFor(p);
+    if (!shards[home].writer->bindTaxi(taxiId, p)) return false;
+    taxiShard[taxiId].store(home, memory_order_release);
+    return true;
+}
+
+bool ShardedIndex::submit(int taxiId, const point& pos) {
+    if (taxiId < 0 || taxiId >= (int)taxiShard.size()) return false;
+
+    // A taxi crossing into another tile takes its attributes along; the new
+    // shard has never seen it and would otherwise start it out available.
+    int home = shardFor(pos);
+    int last = taxiShard[taxiId].load(memory_order_acquire);
+    TaxiAttributes attr;
+    bool migrating = last >= 0 && last != home && shards[last].writer->attributesOf(taxiId, attr);
+    TaxiUpdate update = migrating ? TaxiUpdate(taxiId, pos, attr) : TaxiUpdate(taxiId, pos);
+    if (!shards[home].writer->submit(update)) return false;
+
+    int previous = taxiShard[taxiId].exchange(home, memory_order_acq_rel);
+    if (previous >= 0 && previous != home) {
+        while (!shards[previous].writer->submitRemove(taxiId)) {
+            this_thread::yield();
+        }
+        migrations.fetch_add(1, memory_order_relaxed);
+    }
+    return true;
+}
+
+bool ShardedIndex::submitRemove(int taxiId) {
+    if (taxiId < 0 || taxiId >= (int)taxiShard.size()) return false;
+
+    int previous = taxiShard[taxiId].exchange(-1, memory_order_acq_rel);
+    if (previous < 0) return true;
+    while (!shards[previous].writer->submitRemove(taxiId)) {
+        this_thread::yield();
+    }
+    return true;
+}
+
+// Waits for every queued update to be applied, then rebalances if the
+// tiles have drifted too far apart.
+void ShardedIndex::flush() {
+    stopWriters();
+    if (config.rebalanceSkew > 0 && rebalanceIfSkewed(config.rebalanceSkew)) return;
+    startWriters();
+}
+
+void ShardedIndex::rebalance() {
+    stopWriters();
+
+    vector<point> positions;
+    vector<pair<point, TaxiAttributes>> anonymous;
+    vector<TrackedTaxi> taxis;
+    for (auto& shard : shards) {
+        shard.tree->getAllPoints(positions);
+        shard.writer->anonymousSnapshot(anonymous);
+        vector<TrackedTaxi> owned = shard.writer->taxiSnapshot();
+        taxis.insert(taxis.end(), owned.begin(), owned.end());
+    }
+
+    layoutFromPoints(positions);
+    populate(anonymous, taxis);
+    startWriters();
+}
+
+bool ShardedIndex::rebalanceIfSkewed(double maxSkew) {
+    int total = 0, largest = 0;
+    for (auto& shard : shards) {
+        int n = 0;
+        shard.writer->withIndex([&n](SpatialIndex& index) { n = index.size(); });
+        total += n;
+        largest = max(largest, n);
+    }
+    if (total == 0 || total < config.rebalanceMinTaxis) return false;
+
+    double mean = (double)total / shards.size();
+    if (largest <= maxSkew * mean) return false;
+
+    rebalance();
+    return true;
+}
+
+vector<ShardStats> ShardedIndex::shardStats() {
+    vector<ShardStats> stats;
+    for (auto& shard : shards) {
+        ShardStats s;
+        s.minX = shard.minX;
+        s.maxX = shard.maxX;
+        s.minY = shard.minY;
+        s.maxY = shard.maxY;
+        shard.writer->withIndex([&s](SpatialIndex& index) { s.size = index.size(); });
+        s.ingest = shard.writer->metrics();
+        stats.push_back(s);
+    }
+    return stats;
+}
+
+size_t ShardedIndex::migrationCount() const {
+    return migrations.load(memory_order_relaxed);
+}
+
+int ShardedIndex::shardCount() const {
+    return shards.size();
+}
+
+void ShardedIndex::buildFromVector(const vector<point>& points) {
+    buildFromVector(points, vector<TaxiAttributes>());
+}
+
+void ShardedIndex::buildFromVector(const vector<point>& points, const vector<TaxiAttributes>& attrs) {
+    vector<pair<point, TaxiAttributes>> taxis;
+    for (size_t i = 0; i < points.size(); i++) {
+        taxis.push_back({points[i], attrs.empty() ? TaxiAttributes() : attrs[i]});
+    }
+
+    stopWriters();
+    layoutFromPoints(points);
+    populate(taxis, {});
+    startWriters();
+}
+
+void ShardedIndex::insert(const point& p) {
+    shards[shardFor(p)].writer->insertPoint(p);
+}
+
+void ShardedIndex::insert(const point& p, const TaxiAttributes& attr) {
+    shards[shardFor(p)].writer->insertPoint(p, attr);
+}
+
+bool ShardedIndex::setAttributes(const point& p, const TaxiAttributes& attr) {
+    bool found = false;
+    shards[shardFor(p)].writer->withIndex([&](SpatialIndex& index) { found = index.setAttributes(p, attr); });
+    return found;
+}
+
+bool ShardedIndex::getAttributes(const point& p, TaxiAttributes& attr) {
+    bool found = false;
+    shards[shardFor(p)].writer->withIndex([&](SpatialIndex& index) { found = index.getAttributes(p, attr); });
+    return found;
+}
+
+bool ShardedIndex::deletePoint(const point& p) {
+    return shards[shardFor(p)].writer->deletePoint(p);
+}
+
+bool ShardedIndex::search(const point& p) {
+    bool found = false;
+    shards[shardFor(p)].writer->withIndex([&](SpatialIndex& index) { found = index.search(p); });
+    return found;
+}
+
+vector<point> ShardedIndex::kNearestNeighbors(const point& query, int k) {
+    return kNearestNeighbors(query, k, TaxiFilter::any());
+}
+
+vector<point> ShardedIndex::kNearestNeighbors(const point& query, int k, const TaxiFilter& filter) {
+    vector<point> result;
+    if (k <= 0) return result;
+
+    vector<pair<double, point>> best;
+    auto merge = [&](const vector<point>& found) {
+        for (const auto& p : found) best.push_back({p.distance(query), p});
+        sort(best.begin(), best.end(), [](const pair<double, point>& a, const pair<double, point>& b) {
+            return a.first < b.first;
+        });
+        if ((int)best.size() > k) best.erase(best.begin() + k, best.end());
+    };
+
+    int home = shardFor(query);
+    merge(shards[home].writer->kNearestNeighbors(query, k, filter));
+
+    vector<pair<double, int>> others;
+    for (int i = 0; i < (int)shards.size(); i++) {
+        if (i != home) others.push_back({tileDistance(shards[i], query), i});
+    }
+    sort(others.begin(), others.end());
+
+    for (const auto& other : others) {
+        if ((int)best.size() == k && other.first >= best.back().first) break;
+        merge(shards[other.second].writer->kNearestNeighbors(query, k, filter));
+    }
+
+    for (const auto& entry : best) result.push_back(entry.second);
+    return result;
+}
+
+vector<point> ShardedIndex::rangeSearch(const point& low, const point& high) {
+    vector<point> result;
+    for (auto& shard : shards) {
+        if (shard.maxX < low.x || shard.minX > high.x || shard.maxY < low.y || shard.minY > high.y) continue;
+        shard.writer->withIndex([&](SpatialIndex& index) {
+            vector<point> found = index.rangeSearch(low, high);
+            result.insert(result.end(), found.begin(), found.end());
+        });
+    }
+    return result;
+}
+
+int ShardedIndex::getHeight() {
+    int height = 0;
+    for (auto& shard : shards) {
+        shard.writer->withIndex([&height](SpatialIndex& index) { height = max(height, index.getHeight()); });
+    }
+    return height;
+}
+
+int ShardedIndex::size() {
+    int total = 0;
+    for (auto& shard : shards) {
+        shard.writer->withIndex([&total](SpatialIndex& index) { total += index.size(); });
+    }
+    return total;
+}
+
+void ShardedIndex::getAllPoints(vector<point>& points) {
+    for (auto& shard : shards) {
+        shard.writer->withIndex([&points](SpatialIndex& index) { index.getAllPoints(points); });
+    }
+}
+
+void ShardedIndex::getAllTaxis(vector<pair<point, TaxiAttributes>>& taxis) {
+    for (auto& shard : shards) {
+        shard.writer->withIndex([&taxis](SpatialIndex& index) { index.getAllTaxis(taxis); });
+    }
+}
+
+string ShardedIndex::name() const {
+    return "sharded";
+}
@@ -0,0 +1,55 @@
+#include "spatial_index.h"
+#include "dynamic_kd_tree.h"
+#include "grid_index.h"
+#include "compact_kd_tree.h"
+
+KnnResult SpatialIndex::kNearestNeighbors(const point& query, int k, const TaxiFilter& filter,
+                                          const KnnOptions& /*options*/) {
+    KnnResult result;
+    result.points = kNearestNeighbors(query, k, filter);
+    return result;
+}
+
+int SpatialIndex::rangeCount(const point& low, const point& high, bool availableOnly) {
+    if (!availableOnly) return rangeSearch(low, high).size();
+
+    int count = 0;
+    TaxiAttributes attr;
+    for (const auto& p : rangeSearch(low, high)) {
+        if (getAttributes(p, attr) && attr.available()) count++;
+    }
+    return count;
+}
+
+vector<int> SpatialIndex::zoneCounts(const ZoneGrid& grid, bool availableOnly) {
+    vector<int> counts;
+    if (!grid.valid()) return counts;
+    counts.assign((size_t)grid.cols * grid.rows, 0);
+
+    vector<pair<point, TaxiAttributes>> taxis;
+    getAllTaxis(taxis);
+    for (const auto& taxi : taxis) {
+        if (availableOnly && !taxi.second.available()) continue;
+        long long dx = (long long)taxi.first.x - grid.origin.x;
+        long long dy = (long long)taxi.first.y - grid.origin.y;
+        if (dx < 0 || dy < 0) continue;
+        long long col = dx / grid.cellWidth, row = dy / grid.cellHeight;
+        if (col < grid.cols && row < grid.rows) counts[row * grid.cols + col]++;
+    }
+    return counts;
+}
+
+unique_ptr<SpatialIndex> makeSpatialIndex(const string& kind) {
+    if (kind == "grid") {
+        return unique_ptr<SpatialIndex>(new UniformGridIndex());
+    }
+    if (kind == "compact") {
+        return makeCompactKDTree(-100, 100);
+    }
+    if (kind == "kdtree-lazy") {
+        DynamicKDTree* tree = new DynamicKDTree();
+        tree->setDeleteMode(DeleteMode::TOMBSTONE);
+        return unique_ptr<SpatialIndex>(tree);
+    }
+    return unique_ptr<SpatialIndex>(new DynamicKDTree());
+}
\ No newline at end of file
@@ -0,0 +1,448 @@
+#include "taxi_engine.h"
+#include "batch_dispatcher.h"
+#include "taxi.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <sstream>
+
+TaxiEngine::TaxiEngine(const string& indexKind, const string& stateFile)
+    : index(makeSpatialIndex(indexKind)), stateFile(stateFile), subscriptions(*index), routeSearches(0),
+      routeRejections(0) {}
+
+// Each line is "x y [status vehicleClass capacity]"; older state files
+// only have positions and load as available taxis.
+void TaxiEngine::load() {
+    lock_guard<mutex> guard(lock);
+    vector<point> taxiPoints;
+    vector<TaxiAttributes> taxiAttrs;
+
+    ifstream inFile(stateFile);
+    if (inFile.is_open()) {
+        string line;
+        while (getline(inFile, line)) {
+            istringstream fields(line);
+            int x, y;
+            if (!(fields >> x >> y)) continue;
+            int status = 0, vehicleClass = 0, capacity = 4;
+            fields >> status >> vehicleClass >> capacity;
+            taxiPoints.push_back(point(x, y));
+            taxiAttrs.push_back(TaxiAttributes((TaxiStatus)status, vehicleClass, capacity));
+        }
+        inFile.close();
+    }
+
+    if (taxiPoints.empty()) {
+        srand(42);
+        for (int i = 0; i < 50; i++) {
+            int x = rand() % 100;
+            int y = rand() % 100;
+            taxiPoints.push_back(point(x, y));
+            taxiAttrs.push_back(TaxiAttributes());
+        }
+
+        ofstream outFile(stateFile);
+        for (const auto& p : taxiPoints) {
+            outFile << p.x << " " << p.y << "\n";
+        }
+        outFile.close();
+    }
+
+    index->buildFromVector(taxiPoints, taxiAttrs);
+    cache.clear();
+}
+
+void TaxiEngine::save() {
+    lock_guard<mutex> guard(lock);
+    ofstream outFile(stateFile);
+    vector<pair<point, TaxiAttributes>> allTaxis;
+    index->getAllTaxis(allTaxis);
+    for (const auto& taxi : allTaxis) {
+        outFile << taxi.first.x << " " << taxi.first.y << " " << (int)taxi.second.status << " "
+                << taxi.second.vehicleClass << " " << taxi.second.capacity << "\n";
+    }
+    outFile.close();
+}
+
+// One generator per worker thread. Seeding a fresh mt19937 from
+// random_device for every cell cost more than the rest of the network, and
+// the global rand() lock would serialize workers building networks at once.
+static thread_local mt19937 networkRng(random_device{}());
+
+void TaxiEngine::buildRoadNetwork(const point& pickup, const vector<point>& nearest, GridGraph& roadNetwork) {
+    int qx = pickup.x, qy = pickup.y;
+    vector<pair<int,int>> taxiLocations;
+    for(const auto& taxi : nearest) {
+        taxiLocations.push_back({taxi.x, taxi.y});
+    }
+
+    int minX = qx, maxX = qx, minY = qy, maxY = qy;
+    for(const auto& loc : taxiLocations) {
+        minX = min(minX, loc.first);
+        maxX = max(maxX, loc.first);
+        minY = min(minY, loc.second);
+        maxY = max(maxY, loc.second);
+    }
+
+    int rangeX = maxX - minX;
+    int rangeY = maxY - minY;
+    int expandX = max(rangeX / 2, 15);
+    int expandY = max(rangeY / 2, 15);
+
+    minX -= expandX; maxX += expandX;
+    minY -= expandY; maxY += expandY;
+
+    for(int x = minX; x <= maxX; x++) {
+        for(int y = minY; y <= maxY; y++) {
+            vector<pair<int,int>> neighbors;
+            if(x > minX) neighbors.push_back({x-1, y});
+            if(x < maxX) neighbors.push_back({x+1, y});
+            if(y > minY) neighbors.push_back({x, y-1});
+            if(y < maxY) neighbors.push_back({x, y+1});
+
+            if(!neighbors.empty()) {
+                shuffle(neighbors.begin(), neighbors.end(), networkRng);
+                int numConnections = 1 + (int)(networkRng() % min(3, (int)neighbors.size()));
+                for(int i = 0; i < numConnections; i++) {
+                    roadNetwork.createManhattanPath({x, y}, neighbors[i]);
+                }
+            }
+        }
+    }
+
+    roadNetwork.buildSparseGraph(taxiLocations, {qx, qy});
+}
+
+// Turn points only, which draw the same polyline as every cell would; the
+// full cell list when the client asks for it.
+void TaxiEngine::writePath(ostringstream& out, const RunLengthPath& path, bool expand) {
+    vector<pair<int, int>> points = expand ? path.expand() : path.turnPoints();
+    out << "\"path\":[";
+    for(size_t j = 0; j < points.size(); j++) {
+        out << "{\"x\":" << points[j].first << ",\"y\":" << points[j].second << "}";
+        if(j < points.size() - 1) out << ",";
+    }
+    out << "]";
+}
+
+// Everything after the kNN: the road network, the ranking and the JSON.
+// Touches neither the index nor the cache, so it runs without the lock.
+string TaxiEngine::computeRoute(const point& query, const vector<point>& nearest, bool expand) {
+    int qx = query.x, qy = query.y;
+
+    ostringstream out;
+    if (nearest.empty()) {
+        out << "{\"pickup\":{\"x\":" << qx << ",\"y\":" << qy << "},\"error\":\"No taxis available\"}";
+        return out.str();
+    }
+
+    GridGraph roadNetwork;
+    buildRoadNetwork(query, nearest, roadNetwork);
+
+    // Candidates go in order of their lower bound. Once five routes are
+    // known, a taxi whose bound is no shorter than the longest of them
+    // cannot make the list, and neither can any taxi after it. The bound is
+    // Manhattan distance: every candidate has a Manhattan path to the
+    // pickup, so it is exact here, and landmarks built on this throwaway
+    // network never tightened it while costing a search per landmark.
+    vector<pair<int, int>> order;
+    for (size_t i = 0; i < nearest.size(); i++) {
+        order.push_back({roadNetwork.lowerBound({nearest[i].x, nearest[i].y}, {qx, qy}), (int)i});
+    }
+    stable_sort(order.begin(), order.end(),
+                [](const pair<int, int>& a, const pair<int, int>& b) { return a.first < b.first; });
+
+    vector<TaxiInfo> taxiInfos;
+    for (size_t o = 0; o < order.size(); o++) {
+        if (taxiInfos.size() == ROUTE_LISTED && order[o].first >= taxiInfos.back().graphDist) {
+            routeRejections += order.size() - o;
+            break;
+        }
+        const point& taxi = nearest[order[o].second];
+        TaxiInfo info;
+        info.node = taxi;
+        info.euclideanDist = sqrt(taxi.distanceSquared(query));
+        info.path = roadNetwork.dijkstraPath({taxi.x, taxi.y}, {qx, qy});
+        info.graphDist = info.path.length();
+        routeSearches++;
+
+        auto at = upper_bound(taxiInfos.begin(), taxiInfos.end(), info, [](const TaxiInfo& a, const TaxiInfo& b) {
+            return a.graphDist < b.graphDist;
+        });
+        taxiInfos.insert(at, info);
+        if (taxiInfos.size() > ROUTE_LISTED) taxiInfos.pop_back();
+    }
+
+    out << "{\"pickup\":{\"x\":" << qx << ",\"y\":" << qy << "},";
+
+    out << "\"roadNetwork\":[";
+    vector<pair<pair<int,int>, pair<int,int>>> edges = roadNetwork.getAllEdges();
+    for (size_t i = 0; i < edges.size(); i++) {
+        out << "{\"from\":{\"x\":" << edges[i].first.first << ",\"y\":" << edges[i].first.second << "},";
+        out << "\"to\":{\"x\":" << edges[i].second.first << ",\"y\":" << edges[i].second.second << "}}";
+        if (i < edges.size() - 1) out << ",";
+    }
+    out << "],";
+
+    out << "\"nearestTaxis\":[";
+    for (size_t i = 0; i < taxiInfos.size(); i++) {
+        double estimatedTime = taxiInfos[i].graphDist * 2.0;
+
+        out << "{";
+        out << "\"rank\":" << (i + 1) << ",";
+        out << "\"location\":{\"x\":" << taxiInfos[i].node.x << ",\"y\":" << taxiInfos[i].node.y << "},";
+        out << "\"euclideanDistance\":" << fixed << setprecision(2) << taxiInfos[i].euclideanDist << ",";
+        out << "\"graphDistance\":" << taxiInfos[i].graphDist << ",";
+        out << "\"estimatedTime\":" << fixed << setprecision(2) << estimatedTime << ",";
+
+        writePath(out, taxiInfos[i].path, expand);
+
+        out << "}";
+        if (i < taxiInfos.size() - 1) out << ",";
+    }
+    out << "],";
+
+    const TaxiInfo& selectedTaxi = taxiInfos[0];
+
+    out << "\"nearestTaxi\":{";
+    out << "\"location\":{\"x\":" << selectedTaxi.node.x << ",\"y\":" << selectedTaxi.node.y << "},";
+    out << "\"euclideanDistance\":" << fixed << setprecision(2) << selectedTaxi.euclideanDist << ",";
+    out << "\"graphDistance\":" << selectedTaxi.graphDist << ",";
+    out << "\"estimatedTime\":" << fixed << setprecision(2) << (selectedTaxi.graphDist * 2.0) << ",";
+
+    writePath(out, selectedTaxi.path, expand);
+
+    out << "}}";
+    return out.str();
+}
+
+// Only the cache lookup, the kNN and the region versions it saw are taken
+// under the lock; they have to agree with each other. Building the network
+// and the response, which is nearly all of the work, runs unlocked, and a
+// change landing meanwhile bumps a version the stamp already holds.
+string TaxiEngine::route(const point& pickup, int k, bool expand) {
+    string response;
+    vector<point> nearest;
+    RouteCacheStamp stamp;
+    {
+        lock_guard<mutex> guard(lock);
+        if (!expand && cache.lookup(pickup, k, response)) return response;
+        nearest = index->kNearestNeighbors(pickup, k, TaxiFilter::available());
+        if (!expand) {
+            double radius = (int)nearest.size() < k ? numeric_limits<double>::infinity()
+                                                    : nearest.back().distance(pickup);
+            stamp = cache.stamp(pickup, k, radius);
+        }
+    }
+
+    response = computeRoute(pickup, nearest, expand);
+    if (!expand) cache.store(stamp, response);
+    return response;
+}
+
+// Moves the taxi to the pickup and holds it, or with ride to the dropoff
+// and frees it.
+string TaxiEngine::book(const point& pickup, const point& taxi, bool ride) {
+    int distance;
+    int treeHeight, treeSize;
+    {
+        lock_guard<mutex> guard(lock);
+        vector<point> nearest = index->kNearestNeighbors(pickup, 5, TaxiFilter::available());
+        GridGraph roadNetwork;
+        buildRoadNetwork(pickup, nearest, roadNetwork);
+        distance = roadNetwork.dijkstra({taxi.x, taxi.y}, {pickup.x, pickup.y});
+
+        TaxiAttributes attr;
+        index->getAttributes(taxi, attr);
+        attr.status = ride ? TaxiStatus::AVAILABLE : TaxiStatus::BOOKED;
+        index->deletePoint(taxi);
+        index->insert(pickup, attr);
+        treeHeight = index->getHeight();
+        treeSize = index->size();
+        cache.onTaxiChanged(taxi);
+        cache.onTaxiChanged(pickup);
+        recordDeltas(subscriptions.onTaxiMoved(taxi, pickup));
+    }
+    save();
+
+    double time = distance * 2.0;
+    ostringstream out;
+    out << "{";
+    out << "\"success\":true,";
+    out << "\"movedFrom\":{\"x\":" << taxi.x << ",\"y\":" << taxi.y << "},";
+    out << "\"movedTo\":{\"x\":" << pickup.x << ",\"y\":" << pickup.y << "},";
+    out << "\"distance\":" << fixed << setprecision(2) << distance << ",";
+    out << "\"time\":" << fixed << setprecision(2) << time << ",";
+    out << "\"treeHeight\":" << treeHeight << ",";
+    out << "\"treeSize\":" << treeSize << ",";
+    out << "\"status\":\"" << (ride ? "available" : "booked") << "\"";
+    out << "}";
+    return out.str();
+}
+
+// Assigns every pickup in the window at once and moves the chosen taxis to
+// their pickups, booked. Costs are Manhattan distances with no road graph:
+// buildRoadNetwork links every candidate to its pickup by a Manhattan path
+// and its streets have unit length, so a road search could only return the
+// same number after building the network.
+string TaxiEngine::dispatch(const vector<point>& pickups) {
+    vector<PickupRequest> window;
+    for (const auto& p : pickups) {
+        window.push_back(PickupRequest(window.size(), p));
+    }
+
+    DispatchResult result;
+    {
+        lock_guard<mutex> guard(lock);
+        BatchDispatcher dispatcher(*index);
+        result = dispatcher.dispatch(window);
+        for (const auto& b : result.bookings) {
+            cache.onTaxiChanged(b.taxi);
+            cache.onTaxiChanged(b.pickup);
+            recordDeltas(subscriptions.onTaxiMoved(b.taxi, b.pickup));
+        }
+    }
+    save();
+
+    ostringstream out;
+    out << "{\"bookings\":[";
+    for (size_t i = 0; i < result.bookings.size(); i++) {
+        const Booking& b = result.bookings[i];
+        out << "{\"rider\":" << b.riderId << ",";
+        out << "\"pickup\":{\"x\":" << b.pickup.x << ",\"y\":" << b.pickup.y << "},";
+        out << "\"taxi\":{\"x\":" << b.taxi.x << ",\"y\":" << b.taxi.y << "},";
+        out << "\"distance\":" << b.distance << ",";
+        out << "\"estimatedTime\":" << fixed << setprecision(2) << b.distance * 2.0 << "}";
+        if (i < result.bookings.size() - 1) out << ",";
+    }
+    out << "],\"unassigned\":[";
+    for (size_t i = 0; i < result.unassigned.size(); i++) {
+        out << result.unassigned[i];
+        if (i < result.unassigned.size() - 1) out << ",";
+    }
+    out << "],";
+    out << "\"totalDistance\":" << result.totalDistance << ",";
+    out << "\"components\":" << result.components << ",";
+    out << "\"greedyComponents\":" << result.greedyComponents << ",";
+    out << "\"elapsedMs\":" << fixed << setprecision(2) << result.elapsedMs;
+    out << "}";
+    return out.str();
+}
+
+void TaxiEngine::writePoints(ostringstream& out, const string& key, const vector<point>& points) {
+    out << "\"" << key << "\":[";
+    for (size_t i = 0; i < points.size(); i++) {
+        out << "{\"x\":" << points[i].x << ",\"y\":" << points[i].y << "}";
+        if (i < points.size() - 1) out << ",";
+    }
+    out << "]";
+}
+
+// Folds new deltas into what each subscription has not polled yet; a taxi
+// that left and came back since then cancels out.
+void TaxiEngine::recordDeltas(const vector<KnnDelta>& deltas) {
+    for (const auto& delta : deltas) {
+        KnnDelta& pending = pendingDeltas[delta.subscriptionId];
+        pending.subscriptionId = delta.subscriptionId;
+        for (const auto& p : delta.removed) {
+            auto it = find(pending.added.begin(), pending.added.end(), p);
+            if (it != pending.added.end()) pending.added.erase(it);
+            else pending.removed.push_back(p);
+        }
+        for (const auto& p : delta.added) {
+            auto it = find(pending.removed.begin(), pending.removed.end(), p);
+            if (it != pending.removed.end()) pending.removed.erase(it);
+            else pending.added.push_back(p);
+        }
+    }
+}
+
+string TaxiEngine::subscribe(const point& pickup, int k) {
+    lock_guard<mutex> guard(lock);
+    int id = subscriptions.subscribe(pickup, k);
+    ostringstream out;
+    out << "{\"subscription\":" << id << ",";
+    writePoints(out, "taxis", subscriptions.current(id));
+    out << "}";
+    return out.str();
+}
+
+bool TaxiEngine::pollSubscription(int id, string& response) {
+    lock_guard<mutex> guard(lock);
+    if (!subscriptions.hasSubscription(id)) return false;
+
+    KnnDelta pending;
+    auto it = pendingDeltas.find(id);
+    if (it != pendingDeltas.end()) {
+        pending = it->second;
+        pendingDeltas.erase(it);
+    }
+
+    ostringstream out;
+    out << "{\"subscription\":" << id << ",";
+    writePoints(out, "added", pending.added);
+    out << ",";
+    writePoints(out, "removed", pending.removed);
+    out << ",";
+    writePoints(out, "taxis", subscriptions.current(id));
+    out << "}";
+    response = out.str();
+    return true;
+}
+
+bool TaxiEngine::unsubscribe(int id) {
+    lock_guard<mutex> guard(lock);
+    if (!subscriptions.hasSubscription(id)) return false;
+    subscriptions.unsubscribe(id);
+    pendingDeltas.erase(id);
+    return true;
+}
+
+int TaxiEngine::size() const {
+    lock_guard<mutex> guard(lock);
+    return index->size();
+}
+
+RouteCacheMetrics TaxiEngine::cacheMetrics() const {
+    return cache.metrics();
+}
+
+string TaxiEngine::metricsJson() const {
+    RouteCacheMetrics m = cache.metrics();
+    size_t lookups = m.hits + m.misses;
+    size_t searches = routeSearches.load(), rejections = routeRejections.load();
+    size_t subscribed, recomputations, incremental;
+    {
+        lock_guard<mutex> guard(lock);
+        subscribed = subscriptions.subscriptionCount();
+        recomputations = subscriptions.recomputationCount();
+        incremental = subscriptions.incrementalUpdateCount();
+    }
+
+    ostringstream out;
+    out << "{\"taxis\":" << size() << ",";
+    out << "\"routeCache\":{";
+    out << "\"hits\":" << m.hits << ",";
+    out << "\"misses\":" << m.misses << ",";
+    out << "\"hitRate\":" << fixed << setprecision(4) << (lookups ? (double)m.hits / lookups : 0.0) << ",";
+    out << "\"invalidations\":" << m.invalidations << ",";
+    out << "\"evictions\":" << m.evictions << ",";
+    out << "\"regionBumps\":" << m.regionBumps << ",";
+    out << "\"entries\":" << m.entries << ",";
+    out << "\"bytes\":" << m.bytes;
+    out << "},";
+    out << "\"routing\":{";
+    out << "\"searches\":" << searches << ",";
+    out << "\"rejected\":" << rejections;
+    out << "},";
+    out << "\"subscriptions\":{";
+    out << "\"active\":" << subscribed << ",";
+    out << "\"recomputations\":" << recomputations << ",";
+    out << "\"incrementalUpdates\":" << incremental;
+    out << "}}";
+    return out.str();
+}
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "batch_dispatcher.h"
+#include "dynamic_kd_tree.h"
+#include "ingest_writer.h"
+#include "knn_subscriptions.h"
+#include "sharded_index.h"
+#include "taxi_engine.h"
+
+using namespace std;
+
+// Regression checks for behaviour the benchmark and simulator do not pin
+// down. Each case prints ok or FAIL; the exit status is the failure count,
+// so ctest treats any failure as a failed run.
+// Usage: taxi_checks
+
+static int failures = 0;
+
+static void expect(bool condition, const string& what) {
+    cout << (condition ? "ok   " : "FAIL ") << what << endl;
+    if (!condition) failures++;
+}
+
+static bool hasStatus(SpatialIndex& index, const point& p, TaxiStatus status) {
+    TaxiAttributes attr;
+    return index.getAttributes(p, attr) && attr.status == status;
+}
+
+// A GPS fix moves a taxi; it must not reset a booking or the vehicle.
+static void ingestMoveKeepsAttributes() {
+    DynamicKDTree tree;
+    IngestWriter writer(tree);
+    writer.applyNow(TaxiUpdate(1, point(10, 10)));
+    tree.setAttributes(point(10, 10), TaxiAttributes(TaxiStatus::BOOKED, 3, 6));
+    writer.applyNow(TaxiUpdate(1, point(11, 10)));
+
+    TaxiAttributes attr;
+    bool found = tree.getAttributes(point(11, 10), attr);
+    expect(found && attr.status == TaxiStatus::BOOKED && attr.vehicleClass == 3 && attr.capacity == 6,
+           "ingest move keeps a booked taxi booked, with its class and capacity");
+    expect(!tree.search(point(10, 10)), "ingest move leaves nothing at the old cell");
+    expect(tree.kNearestNeighbors(point(11, 10), 1, TaxiFilter::available()).empty(),
+           "moved booked taxi stays out of available kNN");
+    expect(hasStatus(tree, point(11, 10), TaxiStatus::BOOKED), "booked status readable after the move");
+}
+
+// Points loaded before the writer existed move once bound to a taxi id,
+// and only updates that change the index count as applied.
+static void ingestBoundTaxiMoves() {
+    DynamicKDTree tree({point(5, 5), point(20, 20)});
+    IngestWriter writer(tree);
+    expect(writer.bindTaxi(7, point(5, 5)) && !writer.bindTaxi(7, point(20, 20)) && !writer.bindTaxi(8, point(1, 1)),
+           "bindTaxi takes an existing point once per id");
+    writer.applyNow(TaxiUpdate(7, point(6, 6)));
+    expect(!tree.search(point(5, 5)) && tree.search(point(6, 6)) && tree.size() == 2,
+           "first move of a bound taxi leaves no ghost behind");
+
+    writer.applyNow(TaxiUpdate(7, point(6, 6)));
+    writer.applyNow(TaxiUpdate(9, point(0, 0), UpdateKind::REMOVE));
+    expect(writer.metrics().applied == 1, "repeated positions and unknown removals are not counted as applied");
+
+    ShardedIndex sharded;
+    sharded.buildFromVector({point(-50, -50), point(50, 50)});
+    expect(sharded.bindTaxi(3, point(-50, -50)), "sharded index binds a loaded point");
+    sharded.submit(3, point(50, -50));
+    sharded.flush();
+    expect(!sharded.search(point(-50, -50)) && sharded.search(point(50, -50)) && sharded.size() == 2,
+           "bound taxi migrates between shards without a ghost");
+}
+
+// Filtered kNN on index against a reference tree holding the same taxis:
+// the same distances, and every answer passes the filter in the reference.
+static bool sameFilteredKnn(SpatialIndex& index, DynamicKDTree& reference, const vector<point>& queries,
+                            const TaxiFilter& filter) {
+    for (const auto& q : queries) {
+        vector<point> got = index.kNearestNeighbors(q, 5, filter);
+        vector<point> want = reference.kNearestNeighbors(q, 5, filter);
+        if (got.size() != want.size()) return false;
+        for (size_t i = 0; i < got.size(); i++) {
+            TaxiAttributes attr;
+            if (!reference.getAttributes(got[i], attr) || !filter.matches(attr)) return false;
+            if (fabs(got[i].distance(q) - want[i].distance(q)) > 1e-9) return false;
+        }
+    }
+    return true;
+}
+
+// Rebalancing rebuilds every shard; booked taxis, classes and capacities
+// must come through it, and through a taxi crossing a tile edge.
+static void shardRebalanceKeepsAttributes() {
+    ShardConfig config;
+    config.rebalanceSkew = 0;  // only the explicit rebalance below
+    config.rebalanceMinTaxis = 1;
+    ShardedIndex sharded(config);
+
+    mt19937 rng(11);
+    uniform_int_distribution<int> corner(40, 100), anywhere(-100, 100);
+    vector<point> positions;
+    for (int id = 0; id < 600; id++) {
+        positions.push_back(point(corner(rng), corner(rng)));
+        sharded.submit(id, positions.back());
+    }
+    sharded.flush();
+
+    for (int id = 0; id < 600; id += 3) {
+        sharded.setAttributes(positions[id], TaxiAttributes(TaxiStatus::BOOKED, id % 4, 2 + id % 5));
+    }
+    for (int id = 1; id < 600; id += 3) {
+        sharded.setAttributes(positions[id], TaxiAttributes(TaxiStatus::AVAILABLE, id % 4, 2 + id % 5));
+    }
+
+    vector<point> queries;
+    for (int i = 0; i < 200; i++) queries.push_back(point(anywhere(rng), anywhere(rng)));
+    vector<TaxiFilter> filters = {TaxiFilter::available(), TaxiFilter::available(2), TaxiFilter::available(-1, 5),
+                                  TaxiFilter(false, 1, 0)};
+
+    auto reference = [&sharded](DynamicKDTree& tree) {
+        vector<pair<point, TaxiAttributes>> taxis;
+        sharded.getAllTaxis(taxis);
+        vector<point> points;
+        vector<TaxiAttributes> attrs;
+        for (const auto& taxi : taxis) {
+            points.push_back(taxi.first);
+            attrs.push_back(taxi.second);
+        }
+        tree.buildFromVector(points, attrs);
+    };
+    DynamicKDTree before;
+    reference(before);
+    int booked = 0;
+    for (const auto& p : positions) booked += hasStatus(before, p, TaxiStatus::BOOKED);
+
+    bool skewed = sharded.rebalanceIfSkewed(2.0);
+    bool same = true;
+    for (const auto& filter : filters) same = same && sameFilteredKnn(sharded, before, queries, filter);
+    int stillBooked = 0;
+    for (const auto& p : positions) stillBooked += hasStatus(sharded, p, TaxiStatus::BOOKED);
+    expect(skewed && booked > 0 && stillBooked == booked, "rebalance keeps every booked taxi booked");
+    expect(same, "attribute-filtered kNN matches after rebalance");
+
+    int crossing = 0;
+    while (positions[crossing].x < 0 || !hasStatus(sharded, positions[crossing], TaxiStatus::BOOKED)) crossing++;
+    point away(-positions[crossing].x, -positions[crossing].y);
+    sharded.submit(crossing, away);
+    sharded.flush();
+    TaxiAttributes attr;
+    expect(sharded.getAttributes(away, attr) && attr.status == TaxiStatus::BOOKED &&
+               attr.vehicleClass == crossing % 4 && attr.capacity == 2 + crossing % 5,
+           "taxi migrating to another shard keeps its attributes");
+}
+
+// A dispatched taxi goes where a booked one does: to the pickup, booked,
+// and out of its old cell.
+static void dispatchMovesTaxisToPickups() {
+    DynamicKDTree tree;
+    tree.buildFromVector({point(0, 0), point(50, 50), point(90, 0)},
+                         {TaxiAttributes(TaxiStatus::AVAILABLE, 1, 6), TaxiAttributes(), TaxiAttributes()});
+    BatchDispatcher dispatcher(tree);
+    DispatchResult result = dispatcher.dispatch({PickupRequest(0, point(3, 2)), PickupRequest(1, point(48, 50))});
+
+    TaxiAttributes attr;
+    expect(result.bookings.size() == 2 && result.unassigned.empty(), "dispatch serves both riders");
+    expect(tree.getAttributes(point(3, 2), attr) && attr.status == TaxiStatus::BOOKED && attr.vehicleClass == 1 &&
+               attr.capacity == 6,
+           "dispatched taxi is booked at the pickup, with its class and capacity");
+    expect(hasStatus(tree, point(48, 50), TaxiStatus::BOOKED), "second dispatched taxi is booked at its pickup");
+    expect(!tree.search(point(0, 0)) && !tree.search(point(50, 50)), "dispatched taxis leave their old cells");
+    expect(tree.size() == 3 && hasStatus(tree, point(90, 0), TaxiStatus::AVAILABLE),
+           "the taxi left over stays where it was, available");
+}
+
+// A member moving onto another member's cell merges with it; the answer
+// must not list that cell twice and must refill from the index.
+static void subscriptionMergeHasNoDuplicates() {
+    DynamicKDTree tree;
+    tree.buildFromVector({point(1, 0), point(2, 0), point(3, 0), point(9, 0)}, vector<TaxiAttributes>(4));
+    KnnSubscriptionManager subscriptions(tree);
+    int id = subscriptions.subscribe(point(0, 0), 3);
+
+    tree.deletePoint(point(1, 0));
+    tree.insert(point(2, 0));
+    subscriptions.onTaxiMoved(point(1, 0), point(2, 0));
+
+    vector<point> answer = subscriptions.current(id);
+    vector<point> want = tree.kNearestNeighbors(point(0, 0), 3, TaxiFilter::available());
+    expect(count(answer.begin(), answer.end(), point(2, 0)) == 1, "merged taxi is listed once");
+    expect(answer.size() == want.size() && is_permutation(answer.begin(), answer.end(), want.begin()),
+           "answer after a merge matches a fresh kNN");
+}
+
+// Bookings made through the engine reach a rider's subscription, and a
+// poll returns them once.
+static void engineBookingReachesSubscription() {
+    const string stateFile = "taxi_checks_state.txt";
+    {
+        ofstream out(stateFile);
+        out << "1 0\n4 0\n30 30\n";
+    }
+    TaxiEngine engine("kdtree", stateFile);
+    engine.load();
+
+    string response;
+    expect(engine.subscribe(point(0, 0), 2).find("\"subscription\":1") != string::npos,
+           "engine hands out a subscription");
+    engine.book(point(40, 40), point(1, 0), false);
+    bool polled = engine.pollSubscription(1, response);
+    expect(polled && response.find("\"added\":[{\"x\":30,\"y\":30}]") != string::npos &&
+               response.find("\"removed\":[{\"x\":1,\"y\":0}]") != string::npos,
+           "poll reports the booked taxi leaving and the next one entering");
+    engine.pollSubscription(1, response);
+    expect(response.find("\"added\":[],\"removed\":[]") != string::npos, "a second poll has nothing new");
+    expect(engine.unsubscribe(1) && !engine.pollSubscription(1, response), "unsubscribed id is unknown");
+    remove(stateFile.c_str());
+}
+
+int main() {
+    ingestMoveKeepsAttributes();
+    ingestBoundTaxiMoves();
+    shardRebalanceKeepsAttributes();
+    dispatchMovesTaxisToPickups();
+    subscriptionMergeHasNoDuplicates();
+    engineBookingReachesSubscription();
+
+    cout << (failures ? to_string(failures) + " check(s) failed" : string("all checks passed")) << endl;
+    return failures;
+}
@@ -0,0 +1,478 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <set>
+#include <cstdlib>
+#include <thread>
+#include <functional>
+#include <cstdio>
+#include <fstream>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "spatial_index.h"
+#include "dynamic_kd_tree.h"
+#include "ingest_writer.h"
+#include "sharded_index.h"
+#include "reverse_knn.h"
+#include "landmarks.h"
+
+using namespace std;
+
+// Benchmark harness comparing the spatial indexes on taxi workloads.
+// Usage: taxi_benchmark [numTaxis] [numOps] [seed] [producers] [buildTaxis]
+
+struct Workload {
+    string name;
+    vector<point> taxis;
+    vector<point> queries;
+    vector<pair<point, point>> moves;
+};
+
+static double elapsedMs(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// Bytes currently allocated from the heap, allocator overhead included.
+static size_t heapInUse() {
+#ifdef __GLIBC__
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+static point clampToDomain(int x, int y) {
+    return point(min(max(x, -100), 100), min(max(y, -100), 100));
+}
+
+static vector<point> uniqueTaxis(mt19937& rng, int n, bool clustered) {
+    uniform_int_distribution<int> coord(-100, 100);
+    normal_distribution<double> spread(0.0, 8.0);
+    vector<point> hotspots;
+    for (int i = 0; i < 6; i++) hotspots.push_back(point(coord(rng), coord(rng)));
+
+    set<pair<int, int>> seen;
+    vector<point> taxis;
+    while ((int)taxis.size() < n && (int)seen.size() < 201 * 201) {
+        point p(0, 0);
+        if (clustered && rng() % 10 < 8) {
+            const point& h = hotspots[rng() % hotspots.size()];
+            p = clampToDomain(h.x + (int)lround(spread(rng)), h.y + (int)lround(spread(rng)));
+        } else {
+            p = point(coord(rng), coord(rng));
+        }
+        if (seen.insert({p.x, p.y}).second) taxis.push_back(p);
+    }
+    return taxis;
+}
+
+// Each move takes a taxi to a neighbouring free cell, the way GPS updates do.
+static Workload makeWorkload(const string& name, int n, int ops, unsigned seed, bool clustered) {
+    mt19937 rng(seed);
+    Workload w;
+    w.name = name;
+    w.taxis = uniqueTaxis(rng, n, clustered);
+
+    uniform_int_distribution<int> coord(-100, 100);
+    for (int i = 0; i < ops; i++) {
+        const point& near = w.taxis[rng() % w.taxis.size()];
+        w.queries.push_back(rng() % 2 ? point(coord(rng), coord(rng))
+                                      : clampToDomain(near.x + (int)(rng() % 11) - 5,
+                                                      near.y + (int)(rng() % 11) - 5));
+    }
+
+    set<pair<int, int>> occupied;
+    for (const auto& p : w.taxis) occupied.insert({p.x, p.y});
+    vector<point> current = w.taxis;
+    for (int i = 0; i < ops; i++) {
+        int t = rng() % current.size();
+        point to = clampToDomain(current[t].x + (int)(rng() % 5) - 2, current[t].y + (int)(rng() % 5) - 2);
+        if (occupied.count({to.x, to.y})) continue;
+        occupied.erase({current[t].x, current[t].y});
+        occupied.insert({to.x, to.y});
+        w.moves.push_back({current[t], to});
+        current[t] = to;
+    }
+    return w;
+}
+
+static void runIndex(const string& kind, const Workload& w) {
+    size_t heapBefore = heapInUse();
+    unique_ptr<SpatialIndex> index = makeSpatialIndex(kind);
+
+    auto start = chrono::steady_clock::now();
+    index->buildFromVector(w.taxis);
+    double buildMs = elapsedMs(start);
+    size_t heapBytes = heapInUse() - heapBefore;
+
+    start = chrono::steady_clock::now();
+    size_t found = 0;
+    for (const auto& q : w.queries) found += index->kNearestNeighbors(q, 5).size();
+    double knnMs = elapsedMs(start);
+
+    start = chrono::steady_clock::now();
+    for (const auto& q : w.queries) {
+        found += index->rangeSearch(clampToDomain(q.x - 10, q.y - 10), clampToDomain(q.x + 10, q.y + 10)).size();
+    }
+    double rangeMs = elapsedMs(start);
+
+    start = chrono::steady_clock::now();
+    for (const auto& m : w.moves) {
+        index->deletePoint(m.first);
+        index->insert(m.second);
+    }
+    double moveMs = elapsedMs(start);
+
+    start = chrono::steady_clock::now();
+    for (const auto& q : w.queries) found += index->kNearestNeighbors(q, 5).size();
+    double knnAfterMs = elapsedMs(start);
+
+    auto perOpUs = [](double ms, size_t ops) { return ops ? ms * 1000.0 / ops : 0.0; };
+
+    cout << left << setw(10) << w.name << setw(12) << kind
+         << right << fixed << setprecision(2)
+         << setw(11) << buildMs
+         << setw(11) << perOpUs(knnMs, w.queries.size())
+         << setw(11) << perOpUs(rangeMs, w.queries.size())
+         << setw(11) << perOpUs(moveMs, w.moves.size())
+         << setw(13) << perOpUs(knnAfterMs, w.queries.size())
+         << setw(8) << index->size()
+         << setw(9) << (index->size() ? (double)heapBytes / index->size() : 0.0)
+         << "   (" << found << ")" << endl;
+}
+
+// Producers stream GPS updates for the fleet; the timer stops once every
+// update has been applied by the writer thread(s).
+static void runIngest(const string& label, const Workload& w, int producers,
+                      const function<bool(int, const point&)>& submit,
+                      const function<void()>& flush) {
+    int perProducer = w.moves.size() / max(1, producers);
+    auto start = chrono::steady_clock::now();
+
+    vector<thread> threads;
+    for (int t = 0; t < producers; t++) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < perProducer; i++) {
+                const auto& move = w.moves[t * perProducer + i];
+                int taxiId = (t * perProducer + i) % (int)w.taxis.size();
+                while (!submit(taxiId, move.second)) this_thread::yield();
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    flush();
+
+    double ms = elapsedMs(start);
+    size_t total = (size_t)perProducer * producers;
+    cout << left << setw(22) << label << right << fixed << setprecision(2)
+         << setw(12) << ms << setw(14) << (ms > 0 ? total / ms / 1000.0 : 0.0) << endl;
+}
+
+// Approximate k-NN against the exact answer on the same tree. Recall counts
+// returned taxis no farther than the exact k-th, so ties on the integer grid
+// are not held against the approximate search.
+static void runApproximate(const Workload& w, int k) {
+    DynamicKDTree tree(w.taxis);
+
+    vector<vector<point>> exact;
+    auto start = chrono::steady_clock::now();
+    for (const auto& q : w.queries) exact.push_back(tree.kNearestNeighbors(q, k));
+    double exactMs = elapsedMs(start);
+
+    vector<KnnOptions> settings = {KnnOptions(0.1), KnnOptions(0.25), KnnOptions(0.5), KnnOptions(1.0),
+                                   KnnOptions(0.0, 64), KnnOptions(0.0, 16), KnnOptions(0.5, 16)};
+    for (const auto& options : settings) {
+        vector<KnnResult> results;
+        results.reserve(w.queries.size());
+        start = chrono::steady_clock::now();
+        for (const auto& q : w.queries) results.push_back(tree.kNearestNeighbors(q, k, TaxiFilter::any(), options));
+        double ms = elapsedMs(start);
+
+        size_t hits = 0, wanted = 0, flagged = 0, visited = 0;
+        for (size_t i = 0; i < w.queries.size(); i++) {
+            const point& q = w.queries[i];
+            wanted += exact[i].size();
+            flagged += results[i].approximate;
+            visited += results[i].nodesVisited;
+            if (exact[i].empty()) continue;
+            double kth = exact[i].back().distanceSquared(q);
+            for (const auto& p : results[i].points) hits += p.distanceSquared(q) <= kth;
+        }
+
+        size_t n = max((size_t)1, w.queries.size());
+        cout << left << setw(10) << w.name << right << fixed << setprecision(2)
+             << setw(9) << options.epsilon << setw(10) << options.maxNodes
+             << setw(10) << ms * 1000.0 / n
+             << setw(10) << (ms > 0 ? exactMs / ms : 0.0)
+             << setw(9) << setprecision(3) << (wanted ? (double)hits / wanted : 1.0)
+             << setw(11) << setprecision(1) << 100.0 * flagged / n
+             << setw(10) << (double)visited / n << endl;
+    }
+}
+
+// Surge zones: a 20x20 heatmap of 10x10 zones and 21x21 rectangle counts,
+// from subtree counts versus collecting and binning the points.
+static void runZoneCounts(const Workload& w) {
+    DynamicKDTree tree(w.taxis);
+    ZoneGrid grid(point(-100, -100), 10, 10, 20, 20);
+    int rounds = 200;
+    size_t total = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) total += tree.zoneCounts(grid)[i % 400];
+    double heatmapMs = elapsedMs(start);
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) total += tree.SpatialIndex::zoneCounts(grid)[i % 400];
+    double binnedMs = elapsedMs(start);
+
+    start = chrono::steady_clock::now();
+    for (const auto& q : w.queries) total += tree.rangeCount(clampToDomain(q.x - 10, q.y - 10), clampToDomain(q.x + 10, q.y + 10));
+    double countMs = elapsedMs(start);
+
+    start = chrono::steady_clock::now();
+    for (const auto& q : w.queries) {
+        total += tree.rangeSearch(clampToDomain(q.x - 10, q.y - 10), clampToDomain(q.x + 10, q.y + 10)).size();
+    }
+    double searchMs = elapsedMs(start);
+
+    size_t n = max((size_t)1, w.queries.size());
+    cout << left << setw(10) << w.name << right << fixed << setprecision(2)
+         << setw(12) << heatmapMs * 1000.0 / rounds << setw(12) << binnedMs * 1000.0 / rounds
+         << setw(12) << countMs * 1000.0 / n << setw(12) << searchMs * 1000.0 / n
+         << "   (" << total << ")" << endl;
+}
+
+// A freed taxi asks which of 2000 waiting riders it now counts for: the
+// reverse index against running each rider's kNN again.
+static void runReverseKnn(const Workload& w, int k) {
+    DynamicKDTree tree(w.taxis);
+    ReverseKnnIndex reverse(tree, k);
+    vector<point> pickups;
+    for (size_t i = 0; i < w.queries.size() && pickups.size() < 2000; i += 2) pickups.push_back(w.queries[i]);
+    for (const auto& p : pickups) reverse.addRider(p);
+    size_t probes = min((size_t)200, w.moves.size());
+    size_t examinedBefore = reverse.candidatesExamined();
+    size_t joined = 0, naiveJoined = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < probes; i++) joined += reverse.ridersJoinedBy(w.moves[i].second).size();
+    double reverseMs = elapsedMs(start);
+    size_t examined = reverse.candidatesExamined() - examinedBefore;
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < probes; i++) {
+        const point& taxi = w.moves[i].second;
+        for (const auto& p : pickups) {
+            vector<point> nearest = tree.kNearestNeighbors(p, k);
+            if ((int)nearest.size() < k || taxi.distanceSquared(p) < nearest.back().distanceSquared(p)) naiveJoined++;
+        }
+    }
+    double naiveMs = elapsedMs(start);
+
+    size_t n = max((size_t)1, probes);
+    cout << left << setw(10) << w.name << right << fixed << setprecision(2)
+         << setw(12) << naiveMs * 1000.0 / n << setw(12) << reverseMs * 1000.0 / n
+         << setprecision(1) << setw(10) << (double)joined / n << setw(10) << (double)examined / n
+         << "   (" << naiveJoined << ")" << endl;
+}
+
+// Widening a candidate list from 5 to 40 taxis by doubling: re-query with
+// each larger k, or keep pulling from the iterator the first 5 came from.
+static void runIncremental(const Workload& w) {
+    DynamicKDTree tree(w.taxis);
+    size_t requeried = 0, pulled = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (const auto& q : w.queries) {
+        for (int k = 5; k <= 40; k *= 2) requeried += tree.kNearestNeighbors(q, k).size();
+    }
+    double requeryMs = elapsedMs(start);
+
+    start = chrono::steady_clock::now();
+    point taxi(0, 0);
+    for (const auto& q : w.queries) {
+        NearestTaxiIterator it = tree.nearest(q);
+        for (int i = 0; i < 40 && it.next(taxi); i++) pulled++;
+    }
+    double iteratorMs = elapsedMs(start);
+
+    size_t n = max((size_t)1, w.queries.size());
+    cout << left << setw(10) << w.name << right << fixed << setprecision(2)
+         << setw(14) << requeryMs * 1000.0 / n << setw(14) << iteratorMs * 1000.0 / n
+         << "   (" << requeried << ", " << pulled << ")" << endl;
+}
+
+// City-wide road network shaped like the engine's: every cell links to one
+// to three random neighbours.
+static void cityRoads(GridGraph& roads, mt19937& rng) {
+    for (int x = -100; x <= 100; x++) {
+        for (int y = -100; y <= 100; y++) {
+            vector<pair<int, int>> neighbors;
+            if (x > -100) neighbors.push_back({x - 1, y});
+            if (x < 100) neighbors.push_back({x + 1, y});
+            if (y > -100) neighbors.push_back({x, y - 1});
+            if (y < 100) neighbors.push_back({x, y + 1});
+            shuffle(neighbors.begin(), neighbors.end(), rng);
+            int links = 1 + rng() % min(3, (int)neighbors.size());
+            for (int i = 0; i < links; i++) roads.createManhattanPath({x, y}, neighbors[i]);
+        }
+    }
+}
+
+// Cross-city road distances: plain Dijkstra against A* on landmark bounds,
+// with how much of the true distance the bound recovers and the table size.
+static void runLandmarks(unsigned seed) {
+    mt19937 rng(seed);
+    GridGraph roads;
+    cityRoads(roads, rng);
+    uniform_int_distribution<int> coord(-100, 100);
+    vector<pair<pair<int, int>, pair<int, int>>> trips;
+    for (int i = 0; i < 50; i++) trips.push_back({{coord(rng), coord(rng)}, {coord(rng), coord(rng)}});
+
+    long long total = 0, manhattanSum = 0;
+    vector<int> exact;
+    auto start = chrono::steady_clock::now();
+    for (const auto& t : trips) {
+        exact.push_back(roads.dijkstra(t.first, t.second));
+        total += exact.back();
+        manhattanSum += abs(t.first.first - t.second.first) + abs(t.first.second - t.second.second);
+    }
+    double dijkstraMs = elapsedMs(start);
+    cout << left << setw(10) << "none" << right << fixed << setprecision(1) << setw(10) << 0.0
+         << setw(12) << 0 << setw(14) << dijkstraMs * 1000.0 / trips.size()
+         << setprecision(3) << setw(10) << (double)manhattanSum / total << endl;
+
+    string file = "taxi_landmarks.bin";
+    for (int count : {4, 8, 16}) {
+        start = chrono::steady_clock::now();
+        roads.buildLandmarks(count);
+        double buildMs = elapsedMs(start);
+        roads.saveLandmarks(file);
+        ifstream in(file, ios::binary | ios::ate);
+        long long bytes = in.is_open() ? (long long)in.tellg() : 0;
+
+        long long bounds = 0, checked = 0;
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < trips.size(); i++) {
+            checked += roads.dijkstra(trips[i].first, trips[i].second) == exact[i];
+        }
+        double searchMs = elapsedMs(start);
+        for (const auto& t : trips) bounds += roads.lowerBound(t.first, t.second);
+
+        cout << left << setw(10) << count << right << setprecision(1) << setw(10) << buildMs
+             << setw(12) << bytes << setw(14) << searchMs * 1000.0 / trips.size()
+             << setprecision(3) << setw(10) << (double)bounds / total
+             << "   (" << checked << "/" << trips.size() << " exact)" << endl;
+    }
+    remove(file.c_str());
+}
+
+// Cold-start bulk build of a large fleet at increasing thread counts. The
+// -100..100 grid only has 40401 cells, so this fleet spreads wider.
+static void runBuildScaling(int n, unsigned seed) {
+    mt19937 rng(seed);
+    uniform_int_distribution<int> coord(-1000000, 1000000);
+    vector<point> fleet;
+    fleet.reserve(n);
+    for (int i = 0; i < n; i++) fleet.push_back(point(coord(rng), coord(rng)));
+
+    int hardware = max(1, (int)thread::hardware_concurrency());
+    cout << "\nbulk build taxis=" << n << " hardware threads=" << hardware << endl;
+    cout << left << setw(10) << "threads" << right << setw(12) << "build ms" << setw(10) << "speedup" << endl;
+
+    double serialMs = 0;
+    for (int threads = 1; ; threads = min(threads * 2, hardware)) {
+        DynamicKDTree tree;
+        tree.setBuildThreads(threads);
+        auto start = chrono::steady_clock::now();
+        tree.buildFromVector(fleet);
+        double ms = elapsedMs(start);
+        if (threads == 1) serialMs = ms;
+        cout << left << setw(10) << threads << right << fixed << setprecision(1) << setw(12) << ms
+             << setprecision(2) << setw(10) << serialMs / ms << endl;
+        if (threads == hardware) break;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int n = argc > 1 ? atoi(argv[1]) : 20000;
+    int ops = argc > 2 ? atoi(argv[2]) : 100000;
+    unsigned seed = argc > 3 ? (unsigned)atoi(argv[3]) : 42;
+    int producers = argc > 4 ? atoi(argv[4]) : 4;
+    int buildTaxis = argc > 5 ? atoi(argv[5]) : 1000000;
+
+    vector<Workload> workloads = {
+        makeWorkload("uniform", n, ops, seed, false),
+        makeWorkload("clustered", n, ops, seed, true)
+    };
+
+    cout << "taxis=" << n << " ops=" << ops << " seed=" << seed << endl;
+    cout << left << setw(10) << "workload" << setw(12) << "index"
+         << right << setw(11) << "build ms" << setw(11) << "knn us"
+         << setw(11) << "range us" << setw(11) << "move us"
+         << setw(13) << "knn/moved us" << setw(8) << "size" << setw(9) << "B/taxi" << endl;
+
+    for (const auto& w : workloads) {
+        runIndex("kdtree", w);
+        runIndex("kdtree-lazy", w);
+        runIndex("compact", w);
+        runIndex("grid", w);
+    }
+
+    cout << "\napproximate knn k=5 (speedup over exact on the same kdtree)" << endl;
+    cout << left << setw(10) << "workload" << right << setw(9) << "epsilon" << setw(10) << "maxNodes"
+         << setw(10) << "knn us" << setw(10) << "speedup" << setw(9) << "recall"
+         << setw(11) << "approx %" << setw(10) << "visited" << endl;
+    for (const auto& w : workloads) runApproximate(w, 5);
+
+    cout << "\nzone counts, us per call" << endl;
+    cout << left << setw(10) << "workload" << right << setw(12) << "heatmap" << setw(12) << "binned"
+         << setw(12) << "rangeCount" << setw(12) << "rangeSearch" << endl;
+    for (const auto& w : workloads) runZoneCounts(w);
+
+    cout << "\nwiden 5 -> 40 candidates by doubling, us per query" << endl;
+    cout << left << setw(10) << "workload" << right << setw(14) << "re-query knn" << setw(14) << "iterator" << endl;
+    for (const auto& w : workloads) runIncremental(w);
+
+    cout << "\nreverse knn k=5, 2000 waiting riders, us per freed taxi" << endl;
+    cout << left << setw(10) << "workload" << right << setw(12) << "per-rider" << setw(12) << "reverse"
+         << setw(10) << "joined" << setw(10) << "checked" << endl;
+    for (const auto& w : workloads) runReverseKnn(w, 5);
+
+    cout << "\nroad distance across a 201x201 city, us per trip" << endl;
+    cout << left << setw(10) << "landmarks" << right << setw(10) << "build ms" << setw(12) << "table B"
+         << setw(14) << "search us" << setw(10) << "bound" << endl;
+    runLandmarks(seed);
+
+    cout << "\ningest producers=" << producers << endl;
+    cout << left << setw(22) << "writer" << right << setw(12) << "total ms" << setw(14) << "Mupdates/s" << endl;
+    {
+        DynamicKDTree tree(workloads[0].taxis);
+        IngestWriter writer(tree);
+        for (size_t id = 0; id < workloads[0].taxis.size(); id++) writer.bindTaxi(id, workloads[0].taxis[id]);
+        writer.start();
+        runIngest("single kdtree", workloads[0], producers,
+                  [&](int id, const point& p) { return writer.submit(id, p); },
+                  [&]() { writer.stop(); });
+    }
+    for (int side : {2, 4}) {
+        ShardConfig config;
+        config.cols = side;
+        config.rows = side;
+        ShardedIndex sharded(config);
+        sharded.buildFromVector(workloads[0].taxis);
+        for (size_t id = 0; id < workloads[0].taxis.size(); id++) sharded.bindTaxi(id, workloads[0].taxis[id]);
+        runIngest("sharded " + to_string(side) + "x" + to_string(side), workloads[0], producers,
+                  [&](int id, const point& p) { return sharded.submit(id, p); },
+                  [&]() { sharded.flush(); });
+    }
+
+    runBuildScaling(buildTaxis, seed);
+
+    return 0;
+}
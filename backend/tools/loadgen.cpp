@@ -0,0 +1,662 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "point.h"
+
+using namespace std;
+
+// Open-loop load generator for the HTTP API (server.js or taxi_backend --serve).
+// Usage: taxi_loadgen [--host H] [--port P] [--connections C]
+//                     [--trace FILE | --rate R --duration S --mix route,book,ride
+//                      --distribution uniform|clustered --arrivals poisson|constant
+//                      --state taxi_state.txt --seed N] [--save FILE]
+//        taxi_loadgen [--host H] [--port P] --check
+//
+// Every request has an intended send time from the trace. Latency is measured
+// from that time, not from when a connection got round to sending it, so a
+// stalled server is charged for the requests queued behind the stall
+// (coordinated-omission correction). The uncorrected service time is
+// reported alongside for comparison.
+//
+// --check sends malformed and deeply pipelined requests instead and exits
+// non-zero unless the server answers each with the expected status and is
+// still healthy afterwards.
+//
+// Trace lines: "<offsetMs> route px py", "<offsetMs> book px py tx ty",
+// "<offsetMs> ride dx dy tx ty" or "<offsetMs> dispatch x1 y1 x2 y2 ...".
+
+typedef chrono::steady_clock Clock;
+
+enum Endpoint { ROUTE, BOOK, RIDE, DISPATCH, ENDPOINTS };
+static const char* ENDPOINT_NAMES[ENDPOINTS] = {"route", "book", "ride", "dispatch"};
+static const char* ENDPOINT_PATHS[ENDPOINTS] = {"/api/route", "/api/book-taxi", "/api/start-ride", "/api/dispatch"};
+
+struct TraceRequest {
+    double offsetMs;
+    Endpoint endpoint;
+    vector<int> args;
+};
+
+// Log-linear histogram in the style of HdrHistogram: values below 128 are
+// exact and larger ones keep 7 significant bits (under 1% relative error).
+class LatencyHistogram {
+private:
+    static const int SUB_BUCKET_BITS = 7;
+    static const int HALF = 1 << (SUB_BUCKET_BITS - 1);
+    static const int FULL = 1 << SUB_BUCKET_BITS;
+
+    vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t maxValue;
+
+    static int indexOf(uint64_t v) {
+        if (v < (uint64_t)FULL) return (int)v;
+        int shift = 63 - __builtin_clzll(v) - (SUB_BUCKET_BITS - 1);
+        return FULL + (shift - 1) * HALF + (int)((v >> shift) - HALF);
+    }
+
+    // Largest value that maps to the same bucket.
+    static uint64_t highestEquivalent(int index) {
+        if (index < FULL) return index;
+        int shift = (index - FULL) / HALF + 1;
+        uint64_t mantissa = (index - FULL) % HALF + HALF;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+public:
+    LatencyHistogram() : counts(FULL + 64 * HALF, 0), total(0), maxValue(0) {}
+
+    void record(uint64_t micros) {
+        counts[indexOf(micros)]++;
+        total++;
+        maxValue = max(maxValue, micros);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts.size(); i++) counts[i] += other.counts[i];
+        total += other.total;
+        maxValue = max(maxValue, other.maxValue);
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t highest() const { return maxValue; }
+
+    uint64_t percentile(double p) const {
+        if (total == 0) return 0;
+        uint64_t rank = max((uint64_t)1, (uint64_t)ceil(p / 100.0 * total));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen >= rank) return std::min(highestEquivalent((int)i), maxValue);
+        }
+        return maxValue;
+    }
+};
+
+struct EndpointStats {
+    LatencyHistogram corrected;
+    LatencyHistogram service;
+    uint64_t errors = 0;
+    uint64_t late = 0;  // sent more than 1 ms after the intended time
+
+    void merge(const EndpointStats& other) {
+        corrected.merge(other.corrected);
+        service.merge(other.service);
+        errors += other.errors;
+        late += other.late;
+    }
+};
+
+struct Options {
+    string host = "127.0.0.1";
+    int port = 8002;
+    int connections = 16;
+    string traceFile;
+    string saveFile;
+    string stateFile;
+    double rate = 200;
+    double duration = 10;
+    int mix[3] = {80, 15, 5};
+    bool clustered = false;
+    bool poisson = true;
+    unsigned seed = 42;
+    bool check = false;
+};
+
+// ---------- trace synthesis ----------
+
+struct SimTaxi {
+    point at;
+    bool booked;
+};
+
+static point clampToDomain(int x, int y) {
+    return point(min(max(x, -100), 100), min(max(y, -100), 100));
+}
+
+// Tracks where each taxi is after the requests generated so far, so book and
+// ride requests name a taxi that will be at that spot when they are replayed.
+static vector<TraceRequest> synthesize(const Options& opt) {
+    mt19937 rng(opt.seed);
+    uniform_int_distribution<int> coord(-100, 100);
+    normal_distribution<double> spread(0.0, 8.0);
+    vector<point> hotspots;
+    for (int i = 0; i < 6; i++) hotspots.push_back(point(coord(rng), coord(rng)));
+
+    auto location = [&]() {
+        if (opt.clustered && rng() % 10 < 8) {
+            const point& h = hotspots[rng() % hotspots.size()];
+            return clampToDomain(h.x + (int)lround(spread(rng)), h.y + (int)lround(spread(rng)));
+        }
+        return point(coord(rng), coord(rng));
+    };
+
+    vector<SimTaxi> taxis;
+    if (!opt.stateFile.empty()) {
+        ifstream in(opt.stateFile);
+        int x, y, status;
+        string rest;
+        while (in >> x >> y >> status) {
+            getline(in, rest);
+            taxis.push_back({point(x, y), status != 0});
+        }
+    }
+    if (taxis.empty()) cerr << "No taxi state loaded; book and ride requests fall back to route." << endl;
+
+    vector<int> freeTaxis, bookedTaxis;
+    for (int i = 0; i < (int)taxis.size(); i++) (taxis[i].booked ? bookedTaxis : freeTaxis).push_back(i);
+
+    auto takeRandom = [&](vector<int>& from) {
+        size_t i = rng() % from.size();
+        int id = from[i];
+        from[i] = from.back();
+        from.pop_back();
+        return id;
+    };
+
+    exponential_distribution<double> gap(opt.rate / 1000.0);
+    int mixTotal = max(1, opt.mix[0] + opt.mix[1] + opt.mix[2]);
+    vector<TraceRequest> trace;
+    double t = 0;
+    for (long long i = 0; ; i++) {
+        t = opt.poisson ? t + gap(rng) : i * 1000.0 / opt.rate;
+        if (t >= opt.duration * 1000.0) break;
+
+        int pick = rng() % mixTotal;
+        Endpoint e = pick < opt.mix[0] ? ROUTE : pick < opt.mix[0] + opt.mix[1] ? BOOK : RIDE;
+        if (e == RIDE && bookedTaxis.empty()) e = BOOK;
+        if (e == BOOK && freeTaxis.empty()) e = ROUTE;
+
+        point p = location();
+        TraceRequest r{t, e, {p.x, p.y}};
+        if (e != ROUTE) {
+            int id = takeRandom(e == BOOK ? freeTaxis : bookedTaxis);
+            r.args.push_back(taxis[id].at.x);
+            r.args.push_back(taxis[id].at.y);
+            taxis[id].at = p;
+            (e == BOOK ? bookedTaxis : freeTaxis).push_back(id);
+        }
+        trace.push_back(r);
+    }
+    return trace;
+}
+
+static bool loadTrace(const string& file, vector<TraceRequest>& trace) {
+    ifstream in(file);
+    if (!in) return false;
+
+    string line;
+    while (getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        istringstream fields(line);
+        TraceRequest r;
+        string name;
+        if (!(fields >> r.offsetMs >> name)) continue;
+
+        int e = 0;
+        while (e < ENDPOINTS && name != ENDPOINT_NAMES[e]) e++;
+        if (e == ENDPOINTS) {
+            cerr << "Skipping unknown request: " << line << endl;
+            continue;
+        }
+        r.endpoint = (Endpoint)e;
+        int v;
+        while (fields >> v) r.args.push_back(v);
+        trace.push_back(r);
+    }
+    stable_sort(trace.begin(), trace.end(),
+                [](const TraceRequest& a, const TraceRequest& b) { return a.offsetMs < b.offsetMs; });
+    return true;
+}
+
+static void saveTrace(const string& file, const vector<TraceRequest>& trace) {
+    ofstream out(file);
+    out << fixed << setprecision(3);
+    for (const auto& r : trace) {
+        out << r.offsetMs << " " << ENDPOINT_NAMES[r.endpoint];
+        for (int v : r.args) out << " " << v;
+        out << "\n";
+    }
+}
+
+static string requestBody(const TraceRequest& r) {
+    auto pointJson = [](int x, int y) {
+        return "{\"x\":" + to_string(x) + ",\"y\":" + to_string(y) + "}";
+    };
+    const vector<int>& a = r.args;
+    switch (r.endpoint) {
+    case ROUTE:
+        return "{\"pickup\":" + pointJson(a[0], a[1]) + "}";
+    case BOOK:
+        return "{\"pickup\":" + pointJson(a[0], a[1]) + ",\"taxi\":" + pointJson(a[2], a[3]) + "}";
+    case RIDE:
+        return "{\"dropoff\":" + pointJson(a[0], a[1]) + ",\"taxi\":" + pointJson(a[2], a[3]) + "}";
+    default: {
+        string body = "{\"pickups\":[";
+        for (size_t i = 0; i + 1 < a.size(); i += 2) {
+            if (i) body += ",";
+            body += pointJson(a[i], a[i + 1]);
+        }
+        return body + "]}";
+    }
+    }
+}
+
+static bool validRequest(const TraceRequest& r) {
+    size_t need = r.endpoint == ROUTE ? 2 : r.endpoint == DISPATCH ? 0 : 4;
+    return r.args.size() >= need;
+}
+
+// ---------- HTTP client ----------
+
+// One keep-alive connection; reconnects when the server closes it.
+class HttpConnection {
+private:
+    sockaddr_in addr;
+    int fd;
+    string buffer;
+
+    bool connectNow() {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return false;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            closeNow();
+            return false;
+        }
+        return true;
+    }
+
+    void closeNow() {
+        if (fd >= 0) close(fd);
+        fd = -1;
+        buffer.clear();
+    }
+
+    bool readMore() {
+        char chunk[16384];
+        ssize_t n;
+        do {
+            n = recv(fd, chunk, sizeof(chunk), 0);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+        return true;
+    }
+
+public:
+    HttpConnection(const sockaddr_in& addr) : addr(addr), fd(-1) {}
+    ~HttpConnection() { closeNow(); }
+
+    // Returns the HTTP status, or -1 if the exchange failed.
+    int post(const string& host, const string& path, const string& body) {
+        if (fd < 0 && !connectNow()) return -1;
+
+        string request = "POST " + path + " HTTP/1.1\r\nHost: " + host +
+                         "\r\nContent-Type: application/json\r\nContent-Length: " +
+                         to_string(body.size()) + "\r\n\r\n" + body;
+        size_t sent = 0;
+        while (sent < request.size()) {
+            ssize_t n = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                closeNow();
+                return -1;
+            }
+            sent += n;
+        }
+
+        size_t headerEnd;
+        while ((headerEnd = buffer.find("\r\n\r\n")) == string::npos) {
+            if (!readMore()) {
+                closeNow();
+                return -1;
+            }
+        }
+
+        string head = buffer.substr(0, headerEnd);
+        for (auto& c : head) c = tolower(c);
+        int status = atoi(head.c_str() + head.find(' ') + 1);
+        size_t length = 0;
+        size_t at = head.find("content-length:");
+        if (at != string::npos) length = strtoul(head.c_str() + at + 15, nullptr, 10);
+        bool closeAfter = head.find("connection: close") != string::npos ||
+                          head.compare(0, 8, "http/1.0") == 0;
+
+        while (buffer.size() < headerEnd + 4 + length) {
+            if (!readMore()) {
+                closeNow();
+                return -1;
+            }
+        }
+        buffer.erase(0, headerEnd + 4 + length);
+        if (closeAfter) closeNow();
+        return status;
+    }
+};
+
+// ---------- robustness checks ----------
+
+static int connectTo(const sockaddr_in& addr) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (const sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Sends raw bytes on a fresh connection and returns the status of the first
+// response, or -1 if the server hung up without one.
+static int rawExchange(const sockaddr_in& addr, const string& request) {
+    int fd = connectTo(addr);
+    if (fd < 0) return -1;
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) < 0) {
+        close(fd);
+        return -1;
+    }
+    string reply;
+    char chunk[4096];
+    ssize_t n;
+    while (reply.find("\r\n") == string::npos && (n = recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+        reply.append(chunk, n);
+    }
+    close(fd);
+    if (reply.compare(0, 5, "HTTP/") != 0) return -1;
+    return atoi(reply.c_str() + reply.find(' ') + 1);
+}
+
+// Writes count OPTIONS requests back to back on one connection while
+// reading, and returns how many responses came back.
+static size_t pipelineOptions(const sockaddr_in& addr, size_t count) {
+    int fd = connectTo(addr);
+    if (fd < 0) return 0;
+
+    thread writer([fd, count]() {
+        string batch;
+        for (int i = 0; i < 1000; i++) batch += "OPTIONS /api/route HTTP/1.1\r\nHost: check\r\n\r\n";
+        for (size_t sent = 0; sent < count; sent += 1000) {
+            size_t size = min((size_t)1000, count - sent) * (batch.size() / 1000);
+            for (size_t off = 0; off < size;) {
+                ssize_t n = send(fd, batch.data() + off, size - off, MSG_NOSIGNAL);
+                if (n <= 0) return;
+                off += n;
+            }
+        }
+    });
+
+    size_t responses = 0;
+    string pending;
+    char chunk[65536];
+    while (responses < count) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) break;
+        pending.append(chunk, n);
+        size_t at = 0, found;
+        while ((found = pending.find("\r\n\r\n", at)) != string::npos) {
+            responses++;
+            at = found + 4;
+        }
+        pending.erase(0, at);
+    }
+    shutdown(fd, SHUT_RDWR);
+    writer.join();
+    close(fd);
+    return responses;
+}
+
+static int runChecks(const sockaddr_in& addr) {
+    struct Case {
+        const char* name;
+        string request;
+        int expected;
+    };
+    string post = "POST /api/route HTTP/1.1\r\nHost: check\r\n";
+    string route = "{\"pickup\":{\"x\":1,\"y\":2}}";
+    vector<Case> cases = {
+        {"negative Content-Length", post + "Content-Length: -1\r\n\r\n", 400},
+        {"non-numeric Content-Length", post + "Content-Length: 12abc\r\n\r\n", 400},
+        {"empty Content-Length", post + "Content-Length:\r\n\r\n", 400},
+        {"huge Content-Length", post + "Content-Length: 99999999999999999999999\r\n\r\n", 413},
+        {"oversized Content-Length", post + "Content-Length: 10000000\r\n\r\n", 413},
+        {"valid route", post + "Content-Length: " + to_string(route.size()) + "\r\n\r\n" + route, 200},
+    };
+
+    int failures = 0;
+    for (const auto& c : cases) {
+        int status = rawExchange(addr, c.request);
+        bool ok = status == c.expected;
+        failures += !ok;
+        cout << (ok ? "ok   " : "FAIL ") << left << setw(30) << c.name << " status " << status
+             << " (expected " << c.expected << ")" << endl;
+    }
+
+    size_t pipelined = 200000;
+    size_t answered = pipelineOptions(addr, pipelined);
+    bool ok = answered == pipelined;
+    failures += !ok;
+    cout << (ok ? "ok   " : "FAIL ") << left << setw(30) << "pipelined OPTIONS" << " " << answered << "/"
+         << pipelined << " answered" << endl;
+
+    int health = rawExchange(addr, "GET /health HTTP/1.1\r\nHost: check\r\n\r\n");
+    failures += health != 200;
+    cout << (health == 200 ? "ok   " : "FAIL ") << left << setw(30) << "server still healthy" << " status "
+         << health << endl;
+    return failures ? 1 : 0;
+}
+
+// ---------- driver ----------
+
+static uint64_t micros(Clock::duration d) {
+    return (uint64_t)max((long long)0, (long long)chrono::duration_cast<chrono::microseconds>(d).count());
+}
+
+static void printRow(const string& name, const EndpointStats& s, double seconds) {
+    const LatencyHistogram& h = s.corrected;
+    auto ms = [](uint64_t us) { return us / 1000.0; };
+    cout << left << setw(10) << name << right
+         << setw(9) << h.count()
+         << setw(8) << s.errors
+         << setw(10) << fixed << setprecision(1) << (seconds > 0 ? h.count() / seconds : 0)
+         << setprecision(2)
+         << setw(9) << ms(h.percentile(50))
+         << setw(9) << ms(h.percentile(90))
+         << setw(9) << ms(h.percentile(99))
+         << setw(10) << ms(h.percentile(99.9))
+         << setw(10) << ms(h.highest())
+         << setw(12) << ms(s.service.percentile(99))
+         << setw(8) << s.late << endl;
+}
+
+static bool resolve(const Options& opt, sockaddr_in& addr) {
+    addrinfo hints, *resolved;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(opt.host.c_str(), to_string(opt.port).c_str(), &hints, &resolved) != 0) {
+        cerr << "Cannot resolve " << opt.host << endl;
+        return false;
+    }
+    addr = *(sockaddr_in*)resolved->ai_addr;
+    freeaddrinfo(resolved);
+    return true;
+}
+
+static bool parseArgs(int argc, char* argv[], Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        string flag = argv[i];
+        if (flag == "--check") {
+            opt.check = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            cerr << "Missing value for " << flag << endl;
+            return false;
+        }
+        string value = argv[++i];
+        if (flag == "--host") opt.host = value;
+        else if (flag == "--port") opt.port = atoi(value.c_str());
+        else if (flag == "--connections") opt.connections = max(1, atoi(value.c_str()));
+        else if (flag == "--trace") opt.traceFile = value;
+        else if (flag == "--save") opt.saveFile = value;
+        else if (flag == "--state") opt.stateFile = value;
+        else if (flag == "--rate") opt.rate = max(0.001, atof(value.c_str()));
+        else if (flag == "--duration") opt.duration = atof(value.c_str());
+        else if (flag == "--seed") opt.seed = (unsigned)atoi(value.c_str());
+        else if (flag == "--distribution") opt.clustered = value == "clustered";
+        else if (flag == "--arrivals") opt.poisson = value != "constant";
+        else if (flag == "--mix") {
+            if (sscanf(value.c_str(), "%d,%d,%d", &opt.mix[0], &opt.mix[1], &opt.mix[2]) != 3) {
+                cerr << "--mix expects route,book,ride weights" << endl;
+                return false;
+            }
+        } else {
+            cerr << "Unknown option " << flag << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) return 1;
+
+    if (opt.check) {
+        sockaddr_in addr;
+        if (!resolve(opt, addr)) return 1;
+        return runChecks(addr);
+    }
+
+    vector<TraceRequest> trace;
+    if (!opt.traceFile.empty()) {
+        if (!loadTrace(opt.traceFile, trace)) {
+            cerr << "Cannot read trace " << opt.traceFile << endl;
+            return 1;
+        }
+    } else {
+        trace = synthesize(opt);
+    }
+    trace.erase(remove_if(trace.begin(), trace.end(), [](const TraceRequest& r) { return !validRequest(r); }),
+                trace.end());
+
+    if (!opt.saveFile.empty()) {
+        saveTrace(opt.saveFile, trace);
+        cout << "Wrote " << trace.size() << " requests to " << opt.saveFile << endl;
+        return 0;
+    }
+    if (trace.empty()) {
+        cerr << "Nothing to send." << endl;
+        return 1;
+    }
+
+    sockaddr_in addr;
+    if (!resolve(opt, addr)) return 1;
+
+    vector<string> bodies;
+    for (const auto& r : trace) bodies.push_back(requestBody(r));
+
+    cout << "Replaying " << trace.size() << " requests over " << fixed << setprecision(1)
+         << trace.back().offsetMs / 1000.0 << " s on " << opt.connections
+         << " connections to " << opt.host << ":" << opt.port << endl;
+
+    // Requests are handed out strictly in trace order. A connection that is
+    // still waiting on a slow response delays the ones queued behind it, and
+    // that delay counts towards their latency.
+    atomic<size_t> next(0);
+    vector<vector<EndpointStats>> perThread(opt.connections, vector<EndpointStats>(ENDPOINTS));
+    vector<Clock::time_point> lastDone(opt.connections);
+    Clock::time_point start = Clock::now() + chrono::milliseconds(50);
+
+    vector<thread> threads;
+    for (int c = 0; c < opt.connections; c++) {
+        threads.emplace_back([&, c]() {
+            HttpConnection conn(addr);
+            vector<EndpointStats>& stats = perThread[c];
+            lastDone[c] = start;
+            for (size_t i; (i = next.fetch_add(1)) < trace.size(); ) {
+                const TraceRequest& r = trace[i];
+                Clock::time_point intended = start + chrono::microseconds((long long)(r.offsetMs * 1000));
+                this_thread::sleep_until(intended);
+
+                Clock::time_point sent = Clock::now();
+                int status = conn.post(opt.host, ENDPOINT_PATHS[r.endpoint], bodies[i]);
+                Clock::time_point done = Clock::now();
+
+                EndpointStats& s = stats[r.endpoint];
+                s.corrected.record(micros(done - intended));
+                s.service.record(micros(done - sent));
+                if (status < 200 || status >= 300) s.errors++;
+                if (sent - intended > chrono::milliseconds(1)) s.late++;
+                lastDone[c] = done;
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    Clock::time_point end = *max_element(lastDone.begin(), lastDone.end());
+    double seconds = chrono::duration<double>(end - start).count();
+
+    vector<EndpointStats> totals(ENDPOINTS);
+    EndpointStats all;
+    for (const auto& stats : perThread) {
+        for (int e = 0; e < ENDPOINTS; e++) totals[e].merge(stats[e]);
+    }
+    for (const auto& s : totals) all.merge(s);
+
+    cout << "\nLatency in ms, measured from the intended send time (service p99 excludes queueing)\n";
+    cout << left << setw(10) << "endpoint" << right
+         << setw(9) << "count" << setw(8) << "errors" << setw(10) << "req/s"
+         << setw(9) << "p50" << setw(9) << "p90" << setw(9) << "p99" << setw(10) << "p99.9"
+         << setw(10) << "max" << setw(12) << "service p99" << setw(8) << "late" << endl;
+    for (int e = 0; e < ENDPOINTS; e++) {
+        if (totals[e].corrected.count()) printRow(ENDPOINT_NAMES[e], totals[e], seconds);
+    }
+    printRow("all", all, seconds);
+
+    double offered = trace.size() / max(1e-9, trace.back().offsetMs / 1000.0);
+    cout << "\nOffered " << setprecision(1) << offered << " req/s, achieved "
+         << all.corrected.count() / seconds << " req/s over " << setprecision(2) << seconds << " s" << endl;
+    return 0;
+}
@@ -0,0 +1,531 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <deque>
+#include <string>
+#include <random>
+#include <chrono>
+#include <queue>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include "dynamic_kd_tree.h"
+#include "graph.h"
+
+using namespace std;
+
+// Seeded discrete-event city simulation on top of DynamicKDTree and GridGraph.
+// Usage: taxi_sim [numTaxis] [hours] [ridersPerHour] [seed] [kdtree|kdtree-lazy]
+//
+// Taxis drive cell by cell along shortest paths on one seeded city road
+// network, and every step is a real delete + insert in the index. Riders arrive from a demand model whose
+// hotspots rise and fall over time; each one is matched with an
+// availability-filtered kNN query and the road distance to the candidates,
+// and the taxi's status follows it through pickup and drop-off. Nothing reads
+// the wall clock except the timers, so one seed always gives the same city.
+
+typedef chrono::steady_clock Clock;
+
+static const int MIN_COORD = -100;
+static const int MAX_COORD = 100;
+static const int SIDE = MAX_COORD - MIN_COORD + 1;
+
+struct SimConfig {
+    int taxis = 2000;
+    double hours = 2.0;
+    double ridersPerHour = 4000;
+    unsigned seed = 42;
+    bool lazyDeletes = false;
+    int candidates = 5;
+    double secondsPerCell = 6.0;        // about 60 km/h with 100 m cells
+    double maxWaitSeconds = 600.0;      // unmatched riders give up after this
+    double demandPeriodSeconds = 4 * 3600.0;
+    double cruiseProbability = 0.3;     // free taxis that reposition towards demand
+    int landmarks = 8;                  // ALT landmarks on the city roads
+};
+
+enum EventType { RIDER_ARRIVES, RIDER_GIVES_UP, TAXI_STEP };
+
+struct Event {
+    double time;
+    unsigned long long seq;  // ties break in scheduling order
+    EventType type;
+    int id;
+    unsigned epoch;
+
+    bool operator>(const Event& other) const {
+        return time != other.time ? time > other.time : seq > other.seq;
+    }
+};
+
+enum Phase { IDLE, CRUISING, TO_PICKUP, TO_DROPOFF };
+enum RiderState { WAITING, ASSIGNED, RIDING, DONE, ABANDONED };
+
+struct SimTaxi {
+    point at;
+    Phase phase;
+    int rider;
+    vector<pair<int, int>> path;
+    size_t next;
+    unsigned epoch;  // bumped whenever the plan changes, voiding pending steps
+    int blocked;
+};
+
+struct Rider {
+    point pickup;
+    point dropoff;
+    double arrival;
+    RiderState state;
+    int taxi;
+
+    Rider() : pickup(0, 0), dropoff(0, 0), arrival(0), state(WAITING), taxi(-1) {}
+};
+
+struct Hotspot {
+    point center;
+    double spread;
+    double phase;
+};
+
+// Wall time and call counts of the index operations the simulation issues.
+struct EngineCounters {
+    size_t queries = 0, moves = 0, updates = 0, routes = 0;
+    double queryMs = 0, moveMs = 0, updateMs = 0, routeMs = 0;
+};
+
+class CitySimulator {
+private:
+    SimConfig config;
+    mt19937 rng;
+    DynamicKDTree index;
+    GridGraph roads;
+    double roadBuildMs;
+    vector<SimTaxi> taxis;
+    vector<int> occupant;  // taxi id per grid cell, -1 if free
+    vector<Rider> riders;
+    deque<int> waiting;
+    vector<Hotspot> hotspots;
+    priority_queue<Event, vector<Event>, greater<Event>> events;
+    unsigned long long nextSeq;
+    double now;
+    EngineCounters engine;
+
+    size_t processed;
+    size_t matched, completed, abandoned;
+    size_t emptyCells, loadedCells, detours;
+    long long pickupDistance;
+    vector<double> waits;
+
+    static int cell(const point& p) {
+        return (p.x - MIN_COORD) * SIDE + (p.y - MIN_COORD);
+    }
+
+    static pair<int, int> key(const point& p) {
+        return {p.x, p.y};
+    }
+
+    static point clampToDomain(int x, int y) {
+        return point(min(max(x, MIN_COORD), MAX_COORD), min(max(y, MIN_COORD), MAX_COORD));
+    }
+
+    template <typename F>
+    void timed(size_t& calls, double& ms, F call) {
+        Clock::time_point start = Clock::now();
+        call();
+        ms += chrono::duration<double, milli>(Clock::now() - start).count();
+        calls++;
+    }
+
+    void schedule(double at, EventType type, int id, unsigned epoch = 0) {
+        events.push({at, nextSeq++, type, id, epoch});
+    }
+
+    // ---------- demand ----------
+
+    double demandRate(double t) const {
+        double base = config.ridersPerHour / 3600.0;
+        return base * (1.0 + 0.5 * sin(2 * M_PI * t / config.demandPeriodSeconds));
+    }
+
+    // Hotspot weights drift with time; drop-offs follow the opposite phase,
+    // like commutes into and back out of the same districts.
+    point demandLocation(double t, bool dropoff) {
+        if (rng() % 4 == 0) {
+            uniform_int_distribution<int> coord(MIN_COORD, MAX_COORD);
+            return point(coord(rng), coord(rng));
+        }
+
+        vector<double> weights;
+        for (const auto& h : hotspots) {
+            double shift = dropoff ? M_PI : 0.0;
+            weights.push_back(1.0 + 0.8 * sin(2 * M_PI * t / config.demandPeriodSeconds + h.phase + shift));
+        }
+        discrete_distribution<int> pick(weights.begin(), weights.end());
+        const Hotspot& h = hotspots[pick(rng)];
+        normal_distribution<double> spread(0.0, h.spread);
+        return clampToDomain(h.center.x + (int)lround(spread(rng)), h.center.y + (int)lround(spread(rng)));
+    }
+
+    // Non-homogeneous Poisson arrivals by thinning against the peak rate.
+    void scheduleNextArrival(double from) {
+        double peak = 1.5 * config.ridersPerHour / 3600.0;
+        exponential_distribution<double> gap(peak);
+        uniform_real_distribution<double> accept(0.0, 1.0);
+        double t = from;
+        do {
+            t += gap(rng);
+        } while (accept(rng) * peak > demandRate(t));
+        schedule(t, RIDER_ARRIVES, -1);
+    }
+
+    // ---------- index ----------
+
+    TaxiAttributes attributesFor(Phase phase) const {
+        TaxiStatus status = phase == TO_PICKUP ? TaxiStatus::BOOKED
+                          : phase == TO_DROPOFF ? TaxiStatus::ON_RIDE
+                          : TaxiStatus::AVAILABLE;
+        return TaxiAttributes(status);
+    }
+
+    void setPhase(int id, Phase phase) {
+        SimTaxi& taxi = taxis[id];
+        bool statusChanges = attributesFor(taxi.phase).status != attributesFor(phase).status;
+        taxi.phase = phase;
+        if (statusChanges) {
+            timed(engine.updates, engine.updateMs, [&]() { index.setAttributes(taxi.at, attributesFor(phase)); });
+        }
+    }
+
+    void moveTaxi(int id, const point& to) {
+        SimTaxi& taxi = taxis[id];
+        timed(engine.moves, engine.moveMs, [&]() {
+            index.deletePoint(taxi.at);
+            index.insert(to, attributesFor(taxi.phase));
+        });
+        occupant[cell(taxi.at)] = -1;
+        occupant[cell(to)] = id;
+        taxi.at = to;
+        (taxi.phase == TO_DROPOFF ? loadedCells : emptyCells)++;
+    }
+
+    // ---------- driving ----------
+
+    void drive(int id, const vector<pair<int, int>>& path) {
+        SimTaxi& taxi = taxis[id];
+        taxi.path = path;
+        taxi.next = 1;
+        taxi.blocked = 0;
+        taxi.epoch++;
+        if (taxi.next >= taxi.path.size()) {
+            arrive(id);
+            return;
+        }
+        schedule(now + config.secondsPerCell, TAXI_STEP, id, taxi.epoch);
+    }
+
+    // Every cell links to one to three random neighbours, the way the
+    // engine lays its per-request streets, so roads are rarely straight.
+    void buildRoads() {
+        Clock::time_point start = Clock::now();
+        for (int x = MIN_COORD; x <= MAX_COORD; x++) {
+            for (int y = MIN_COORD; y <= MAX_COORD; y++) {
+                vector<pair<int, int>> neighbors;
+                if (x > MIN_COORD) neighbors.push_back({x - 1, y});
+                if (x < MAX_COORD) neighbors.push_back({x + 1, y});
+                if (y > MIN_COORD) neighbors.push_back({x, y - 1});
+                if (y < MAX_COORD) neighbors.push_back({x, y + 1});
+                shuffle(neighbors.begin(), neighbors.end(), rng);
+                int links = 1 + rng() % min(3, (int)neighbors.size());
+                for (int i = 0; i < links; i++) roads.createManhattanPath({x, y}, neighbors[i]);
+            }
+        }
+        if (config.landmarks > 0) roads.buildLandmarks(config.landmarks);
+        roadBuildMs = chrono::duration<double, milli>(Clock::now() - start).count();
+    }
+
+    vector<pair<int, int>> route(const point& from, const point& to) {
+        RunLengthPath path(key(from));
+        timed(engine.routes, engine.routeMs, [&]() { path = roads.dijkstraPath(key(from), key(to)); });
+        return path.expand();
+    }
+
+    void driveTo(int id, const point& target) {
+        drive(id, route(taxis[id].at, target));
+    }
+
+    void step(int id) {
+        SimTaxi& taxi = taxis[id];
+        point next(taxi.path[taxi.next].first, taxi.path[taxi.next].second);
+        bool last = taxi.next + 1 == taxi.path.size();
+
+        if (occupant[cell(next)] >= 0) {
+            // Another taxi holds the cell. At the destination the rider walks
+            // the last block; elsewhere wait, then detour around it.
+            if (last) {
+                arrive(id);
+                return;
+            }
+            if (++taxi.blocked < 3) {
+                schedule(now + config.secondsPerCell / 2, TAXI_STEP, id, taxi.epoch);
+                return;
+            }
+            detour(id);
+            return;
+        }
+
+        taxi.blocked = 0;
+        moveTaxi(id, next);
+        if (++taxi.next >= taxi.path.size()) {
+            arrive(id);
+        } else {
+            schedule(now + config.secondsPerCell, TAXI_STEP, id, taxi.epoch);
+        }
+    }
+
+    void detour(int id) {
+        SimTaxi& taxi = taxis[id];
+        static const int dx[4] = {1, -1, 0, 0};
+        static const int dy[4] = {0, 0, 1, -1};
+        int first = rng() % 4;
+        for (int i = 0; i < 4; i++) {
+            int d = (first + i) % 4;
+            point side(taxi.at.x + dx[d], taxi.at.y + dy[d]);
+            if (side.x < MIN_COORD || side.x > MAX_COORD || side.y < MIN_COORD || side.y > MAX_COORD) continue;
+            if (occupant[cell(side)] >= 0) continue;
+
+            pair<int, int> target = taxi.path.back();
+            moveTaxi(id, side);
+            detours++;
+            driveTo(id, point(target.first, target.second));
+            return;
+        }
+        taxi.blocked = 0;
+        schedule(now + config.secondsPerCell, TAXI_STEP, id, taxi.epoch);
+    }
+
+    void arrive(int id) {
+        SimTaxi& taxi = taxis[id];
+        taxi.epoch++;
+
+        if (taxi.phase == TO_PICKUP) {
+            Rider& rider = riders[taxi.rider];
+            rider.state = RIDING;
+            waits.push_back(now - rider.arrival);
+            setPhase(id, TO_DROPOFF);
+            driveTo(id, rider.dropoff);
+        } else if (taxi.phase == TO_DROPOFF) {
+            riders[taxi.rider].state = DONE;
+            taxi.rider = -1;
+            completed++;
+            setPhase(id, IDLE);
+            serveWaiting();
+            if (taxis[id].phase == IDLE && uniform_real_distribution<double>(0, 1)(rng) < config.cruiseProbability) {
+                setPhase(id, CRUISING);
+                driveTo(id, demandLocation(now, false));
+            }
+        } else {
+            setPhase(id, IDLE);
+        }
+    }
+
+    // ---------- matching ----------
+
+    // kNN over available taxis, then the shortest road distance among them.
+    bool assign(int riderId) {
+        Rider& rider = riders[riderId];
+        vector<point> nearest;
+        timed(engine.queries, engine.queryMs, [&]() {
+            nearest = index.kNearestNeighbors(rider.pickup, config.candidates, TaxiFilter::available());
+        });
+        if (nearest.empty()) return false;
+
+        // Road ties go to the lower cell rather than to kNN order, which
+        // differs between eager and lazy trees.
+        int best = -1, bestDistance = 0;
+        vector<pair<int, int>> bestPath;
+        for (const auto& p : nearest) {
+            vector<pair<int, int>> path = route(p, rider.pickup);
+            int d = (int)path.size() - 1;
+            if (best < 0 || d < bestDistance || (d == bestDistance && cell(p) < cell(taxis[best].at))) {
+                best = occupant[cell(p)];
+                bestDistance = d;
+                bestPath.swap(path);
+            }
+        }
+
+        rider.state = ASSIGNED;
+        rider.taxi = best;
+        matched++;
+        pickupDistance += bestDistance;
+
+        SimTaxi& taxi = taxis[best];
+        taxi.rider = riderId;
+        setPhase(best, TO_PICKUP);
+        drive(best, bestPath);
+        return true;
+    }
+
+    void serveWaiting() {
+        while (!waiting.empty()) {
+            int r = waiting.front();
+            if (riders[r].state != WAITING) {
+                waiting.pop_front();
+                continue;
+            }
+            if (!assign(r)) return;
+            waiting.pop_front();
+        }
+    }
+
+    void riderArrives() {
+        Rider rider;
+        rider.arrival = now;
+        rider.pickup = demandLocation(now, false);
+        do {
+            rider.dropoff = demandLocation(now, true);
+        } while (rider.dropoff == rider.pickup);
+
+        int id = (int)riders.size();
+        riders.push_back(rider);
+        while (!waiting.empty() && riders[waiting.front()].state != WAITING) waiting.pop_front();
+        if (!waiting.empty() || !assign(id)) {
+            waiting.push_back(id);
+            schedule(now + config.maxWaitSeconds, RIDER_GIVES_UP, id);
+        }
+        scheduleNextArrival(now);
+    }
+
+public:
+    CitySimulator(const SimConfig& config)
+        : config(config), rng(config.seed), roadBuildMs(0), occupant(SIDE * SIDE, -1), nextSeq(0), now(0),
+          processed(0), matched(0), completed(0), abandoned(0), emptyCells(0), loadedCells(0),
+          detours(0), pickupDistance(0) {
+        if (config.lazyDeletes) index.setDeleteMode(DeleteMode::TOMBSTONE);
+        buildRoads();
+
+        uniform_int_distribution<int> coord(MIN_COORD + 20, MAX_COORD - 20);
+        uniform_real_distribution<double> unit(0.0, 1.0);
+        for (int i = 0; i < 8; i++) {
+            hotspots.push_back({point(coord(rng), coord(rng)), 5.0 + 10.0 * unit(rng), 2 * M_PI * unit(rng)});
+        }
+
+        uniform_int_distribution<int> anywhere(MIN_COORD, MAX_COORD);
+        vector<point> start;
+        int n = min(config.taxis, SIDE * SIDE / 2);
+        while ((int)start.size() < n) {
+            point p(anywhere(rng), anywhere(rng));
+            if (occupant[cell(p)] >= 0) continue;
+            occupant[cell(p)] = (int)start.size();
+            start.push_back(p);
+            taxis.push_back({p, IDLE, -1, {}, 0, 0, 0});
+        }
+        index.buildFromVector(start);
+        index.resetRebuildStats();
+    }
+
+    void run() {
+        double horizon = config.hours * 3600.0;
+        scheduleNextArrival(0);
+
+        while (!events.empty() && events.top().time <= horizon) {
+            Event e = events.top();
+            events.pop();
+            now = e.time;
+            processed++;
+
+            switch (e.type) {
+            case RIDER_ARRIVES:
+                riderArrives();
+                break;
+            case RIDER_GIVES_UP:
+                if (riders[e.id].state == WAITING) {
+                    riders[e.id].state = ABANDONED;
+                    abandoned++;
+                }
+                break;
+            case TAXI_STEP:
+                if (taxis[e.id].epoch == e.epoch) step(e.id);
+                break;
+            }
+        }
+        now = horizon;
+    }
+
+    void report(double wallSeconds) {
+        auto rate = [](size_t calls, double ms) { return ms > 0 ? calls / (ms / 1000.0) : 0.0; };
+        auto row = [&](const string& name, size_t calls, double ms) {
+            cout << left << setw(16) << name << right << setw(12) << calls
+                 << setw(12) << fixed << setprecision(1) << ms
+                 << setw(14) << setprecision(0) << rate(calls, ms) << endl;
+        };
+
+        cout << fixed << setprecision(2);
+        cout << "Simulated " << now / 3600.0 << " h in " << wallSeconds << " s ("
+             << setprecision(0) << now / max(wallSeconds, 1e-9) << "x real time), "
+             << processed << " events\n\n";
+
+        cout << left << setw(16) << "engine op" << right << setw(12) << "calls"
+             << setw(12) << "total ms" << setw(14) << "ops/s" << endl;
+        row("kNN query", engine.queries, engine.queryMs);
+        row("move", engine.moves, engine.moveMs);
+        row("status update", engine.updates, engine.updateMs);
+        row("road route", engine.routes, engine.routeMs);
+        cout << "City roads built in " << setprecision(1) << roadBuildMs << " ms with " << config.landmarks
+             << " landmarks\n";
+
+        RebuildStats stats = index.rebuildStats();
+        int n = index.size();
+        cout << "\nRebuilds " << stats.rebuilds << " (" << stats.rebuiltNodes << " nodes relinked, "
+             << setprecision(2) << (engine.moves ? (double)stats.rebuiltNodes / engine.moves : 0.0)
+             << " per move), compactions " << stats.compactions << " (" << stats.compactedNodes
+             << " nodes), tombstones " << index.tombstoneCount() << ", height " << index.getHeight()
+             << " for " << n << " taxis (minimum " << (n > 0 ? (int)ceil(log2(n + 1.0)) : 0) << ")\n";
+
+        sort(waits.begin(), waits.end());
+        auto waitAt = [&](double q) { return waits.empty() ? 0.0 : waits[(size_t)(q * (waits.size() - 1))]; };
+        size_t driven = emptyCells + loadedCells;
+
+        cout << "\nRiders " << riders.size() << ": matched " << matched << " ("
+             << setprecision(1) << (riders.empty() ? 0.0 : 100.0 * matched / riders.size()) << "%), completed "
+             << completed << ", abandoned " << abandoned << ", still waiting "
+             << count_if(riders.begin(), riders.end(), [](const Rider& r) { return r.state == WAITING; }) << "\n";
+        cout << "Pickup wait p50 " << setprecision(0) << waitAt(0.5) << " s, p90 " << waitAt(0.9)
+             << " s, p99 " << waitAt(0.99) << " s; mean pickup distance " << setprecision(1)
+             << (matched ? (double)pickupDistance / matched : 0.0) << " cells\n";
+        cout << "Driven " << driven << " cells, " << (driven ? 100.0 * emptyCells / driven : 0.0)
+             << "% empty; " << detours << " detours around blocked cells\n";
+
+        // Same seed and config give the same checksum; use it to tell a
+        // behavioural change from a pure speed change.
+        uint64_t h = 1469598103934665603ULL;
+        auto mix = [&h](long long v) { h = (h ^ (uint64_t)v) * 1099511628211ULL; };
+        for (const auto& t : taxis) {
+            mix(t.at.x);
+            mix(t.at.y);
+            mix(t.phase);
+        }
+        mix((long long)matched);
+        mix((long long)completed);
+        cout << "Checksum " << hex << h << dec << endl;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    SimConfig config;
+    if (argc > 1) config.taxis = max(1, atoi(argv[1]));
+    if (argc > 2) config.hours = atof(argv[2]);
+    if (argc > 3) config.ridersPerHour = max(1.0, atof(argv[3]));
+    if (argc > 4) config.seed = (unsigned)atoi(argv[4]);
+    if (argc > 5) config.lazyDeletes = string(argv[5]) == "kdtree-lazy";
+
+    cout << "City simulation: " << config.taxis << " taxis, " << config.hours << " h, "
+         << config.ridersPerHour << " riders/h, seed " << config.seed << ", "
+         << (config.lazyDeletes ? "kdtree-lazy" : "kdtree") << "\n" << endl;
+
+    CitySimulator sim(config);
+    Clock::time_point start = Clock::now();
+    sim.run();
+    sim.report(chrono::duration<double>(Clock::now() - start).count());
+    return 0;
+}
@@ -7,9 +7,10 @@ const API_BASE_URL = 'http://localhost:8000/api';
 
 export class TaxiService {
   /**
-   * Find nearest taxi for given pickup and dropoff coordinates
+   * Find nearest taxi for given pickup and dropoff coordinates.
+   * Paths arrive as turn points; pass { expand: true } for every grid cell.
    */
-  static async findNearestTaxi(pickup, dropoff) {
+  static async findNearestTaxi(pickup, dropoff, options = {}) {
     try {
       const response = await fetch(`${API_BASE_URL}/route`, {
         method: 'POST',
@@ -18,7 +19,8 @@ export class TaxiService {
         },
         body: JSON.stringify({
           pickup: { x: parseFloat(pickup.x), y: parseFloat(pickup.y) },
-          dropoff: { x: parseFloat(dropoff.x), y: parseFloat(dropoff.y) }
+          dropoff: { x: parseFloat(dropoff.x), y: parseFloat(dropoff.y) },
+          ...(options.expand ? { expand: true } : {})
         })
       });
 
@@ -5,4 +5,5 @@
 
 export { TaxiService } from './api/taxiService.js';
 export { useTaxiBooking } from './hooks/useTaxiBooking.js';
-export { ValidationUtils } from './utils/validation.js';
\ No newline at end of file
+export { ValidationUtils } from './utils/validation.js';
+export { PathUtils } from './utils/path.js';
\ No newline at end of file
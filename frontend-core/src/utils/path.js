@@ -0,0 +1,28 @@
+/**
+ * Path utilities for route responses
+ */
+
+export class PathUtils {
+  /**
+   * Expand a turn-point polyline into every grid cell along it
+   */
+  static expand(points) {
+    if (!points || points.length === 0) return [];
+
+    const cells = [{ x: points[0].x, y: points[0].y }];
+    for (let i = 1; i < points.length; i++) {
+      const dx = Math.sign(points[i].x - points[i - 1].x);
+      const dy = Math.sign(points[i].y - points[i - 1].y);
+      let { x, y } = points[i - 1];
+      while (x !== points[i].x) {
+        x += dx;
+        cells.push({ x, y });
+      }
+      while (y !== points[i].y) {
+        y += dy;
+        cells.push({ x, y });
+      }
+    }
+    return cells;
+  }
+}
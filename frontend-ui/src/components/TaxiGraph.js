@@ -1,4 +1,5 @@
 import React from 'react';
+import { PathUtils } from 'frontend-core';
 
 export function TaxiGraph({ result, pickup, dropoff }) {
   if (!result || result.error || !result.nearestTaxis) {
@@ -122,11 +123,15 @@ export function TaxiGraph({ result, pickup, dropoff }) {
             const strokeWidth = index === 0 ? 4 : 2.5; // Thicker line for shortest path
             const opacity = index === 0 ? 1 : 0.8;
 
-            // Convert path coordinates to SVG coordinates
+            // The API sends turn points only: they draw the polyline, while
+            // the per-cell dots and the midpoint label need every cell
             const pathSVG = taxi.path ? taxi.path.map(point => toSVG(point.x, point.y)) : [];
             
             if (pathSVG.length < 2) return null;
 
+            const cellsSVG = PathUtils.expand(taxi.path).map(point => toSVG(point.x, point.y));
+            const midpoint = cellsSVG[Math.floor(cellsSVG.length / 2)];
+
             // Create path string for SVG
             let pathString = `M ${pathSVG[0].x} ${pathSVG[0].y}`;
             for (let i = 1; i < pathSVG.length; i++) {
@@ -163,7 +168,7 @@ export function TaxiGraph({ result, pickup, dropoff }) {
                 </path>
                 
                 {/* Path nodes (small dots) for shortest path */}
-                {index === 0 && pathSVG.map((point, i) => (
+                {index === 0 && cellsSVG.map((point, i) => (
                   <circle
                     key={`node-${i}`}
                     cx={point.x}
@@ -179,8 +184,8 @@ export function TaxiGraph({ result, pickup, dropoff }) {
                 {/* Distance label at midpoint with background */}
                 <g>
                   <rect
-                    x={pathSVG[Math.floor(pathSVG.length / 2)].x - 20}
-                    y={pathSVG[Math.floor(pathSVG.length / 2)].y - 18}
+                    x={midpoint.x - 20}
+                    y={midpoint.y - 18}
                     width="40"
                     height="16"
                     fill="white"
@@ -188,8 +193,8 @@ export function TaxiGraph({ result, pickup, dropoff }) {
                     rx="3"
                   />
                   <text
-                    x={pathSVG[Math.floor(pathSVG.length / 2)].x}
-                    y={pathSVG[Math.floor(pathSVG.length / 2)].y - 8}
+                    x={midpoint.x}
+                    y={midpoint.y - 8}
                     fill={color}
                     fontSize="10"
                     fontWeight={index === 0 ? "bold" : "normal"}